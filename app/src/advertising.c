@@ -0,0 +1,212 @@
+/** @file
+ *  @brief Advertising and fast reconnection to bonded hosts
+ */
+#include "advertising.h"
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/services/nus.h>
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(advertising);
+
+#define DEVICE_NAME CONFIG_BT_DEVICE_NAME
+#define DEVICE_NAME_LEN	(sizeof(DEVICE_NAME) - 1)
+
+#define FAST_ADV_TIMEOUT K_MSEC(CONFIG_BT_NUS_ADV_FAST_TIMEOUT)
+
+/* Advertising that failed to start is retried with an exponential backoff */
+#define ADV_RETRY_MIN_MS 100
+#define ADV_RETRY_MAX_MS 5000
+
+#define ADV_PARAM_FAST BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME, \
+				       BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, NULL)
+#define ADV_PARAM_SLOW BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME, \
+				       BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, NULL)
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+};
+
+static const struct bt_data sd[] = {
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_NUS_VAL),
+};
+
+enum ADV_MODE {ADV_NONE, ADV_DIRECTED, ADV_FAST, ADV_SLOW};
+
+static const char *const mode_names[] = {"none", "directed", "fast", "slow"};
+
+static enum ADV_MODE mode;
+static enum ADV_MODE next_mode;
+static struct k_work_delayable adv_work;
+static uint32_t retry_ms = ADV_RETRY_MIN_MS;
+
+/* Bonded peer the directed advertising is addressed to */
+static bt_addr_le_t directed_peer;
+static bool directed_peer_valid;
+
+static int conn_count;
+
+/* Disconnect to first request latency of the peer that disconnected last */
+static bt_addr_le_t reconnect_peer;
+static uint32_t disconnect_time;
+static bool reconnecting;
+static enum ADV_MODE reconnect_mode;
+
+struct bond_search {
+	const bt_addr_le_t *addr;
+	bool found;
+};
+
+static void bond_find(const struct bt_bond_info *info, void *user_data)
+{
+	struct bond_search *search = user_data;
+
+	if (search->found) {
+		return;
+	}
+
+	if (!search->addr) {
+		/* Any bond is fine */
+		bt_addr_le_copy(&directed_peer, &info->addr);
+		search->found = true;
+	} else if (!bt_addr_le_cmp(search->addr, &info->addr)) {
+		search->found = true;
+	}
+}
+
+static int adv_start_mode(enum ADV_MODE new_mode)
+{
+	int err;
+
+	(void)bt_le_adv_stop();
+
+	switch (new_mode) {
+	case ADV_DIRECTED:
+		/* The controller stops high duty cycle directed advertising after 1.28 s */
+		err = bt_le_adv_start(BT_LE_ADV_CONN_DIR(&directed_peer), NULL, 0, NULL, 0);
+		break;
+	case ADV_FAST:
+		err = bt_le_adv_start(ADV_PARAM_FAST, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+		if (!err) {
+			next_mode = ADV_SLOW;
+			k_work_reschedule(&adv_work, FAST_ADV_TIMEOUT);
+		}
+		break;
+	case ADV_SLOW:
+		err = bt_le_adv_start(ADV_PARAM_SLOW, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+		break;
+	default:
+		err = 0;
+		break;
+	}
+
+	if (err) {
+		/* -ENOMEM until the main thread has released the last disconnected connection */
+		LOG_WRN("Advertising failed to start (mode %s, err %d), retry in %u ms",
+			mode_names[new_mode], err, retry_ms);
+		next_mode = new_mode;
+		k_work_reschedule(&adv_work, K_MSEC(retry_ms));
+		retry_ms = MIN(2 * retry_ms, ADV_RETRY_MAX_MS);
+		return err;
+	}
+
+	LOG_DBG("Advertising started (mode %s)", mode_names[new_mode]);
+	mode = new_mode;
+	retry_ms = ADV_RETRY_MIN_MS;
+
+	return 0;
+}
+
+static void adv_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	if (conn_count < CONFIG_BT_MAX_CONN) {
+		(void)adv_start_mode(next_mode);
+	}
+}
+
+int advertising_start(void)
+{
+	struct bond_search search = {0};
+
+	k_work_init_delayable(&adv_work, adv_work_handler);
+
+	bt_foreach_bond(BT_ID_DEFAULT, bond_find, &search);
+	directed_peer_valid = search.found;
+
+	return adv_start_mode(directed_peer_valid ? ADV_DIRECTED : ADV_FAST);
+}
+
+static bool is_reconnect_peer(struct bt_conn *conn)
+{
+	return reconnecting && !bt_addr_le_cmp(bt_conn_get_dst(conn), &reconnect_peer);
+}
+
+void advertising_request_received(struct bt_conn *conn)
+{
+	/* Requests from the clients that stayed connected do not count */
+	if (!is_reconnect_peer(conn)) {
+		return;
+	}
+
+	reconnecting = false;
+	LOG_INF("Disconnect to first request: %u ms (reconnected through %s advertising)",
+		k_uptime_get_32() - disconnect_time, mode_names[reconnect_mode]);
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		/* Directed advertising timed out (the bonded peer is not around)
+		 * or the connection could not be established
+		 */
+		LOG_DBG("No connection (err %u)", err);
+		next_mode = ADV_FAST;
+		k_work_reschedule(&adv_work, K_NO_WAIT);
+		return;
+	}
+
+	conn_count++;
+	k_work_cancel_delayable(&adv_work);
+
+	if (is_reconnect_peer(conn)) {
+		reconnect_mode = mode;
+		LOG_INF("Reconnected %u ms after disconnection (%s advertising)",
+			k_uptime_get_32() - disconnect_time, mode_names[reconnect_mode]);
+	}
+	mode = ADV_NONE;
+
+	/* Keep advertising for other clients while there are free connections */
+	next_mode = ADV_FAST;
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct bond_search search = {
+		.addr = bt_conn_get_dst(conn),
+	};
+
+	conn_count--;
+
+	/* Try to get the same host back as soon as possible */
+	bt_foreach_bond(BT_ID_DEFAULT, bond_find, &search);
+	if (search.found) {
+		bt_addr_le_copy(&directed_peer, bt_conn_get_dst(conn));
+		directed_peer_valid = true;
+	}
+
+	bt_addr_le_copy(&reconnect_peer, bt_conn_get_dst(conn));
+	disconnect_time = k_uptime_get_32();
+	reconnecting = true;
+
+	next_mode = directed_peer_valid ? ADV_DIRECTED : ADV_FAST;
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+
+BT_CONN_CB_DEFINE(advertising_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
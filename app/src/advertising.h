@@ -0,0 +1,29 @@
+#ifndef ADVERTISING_H_
+#define ADVERTISING_H_
+
+#include <zephyr.h>
+#include <bluetooth/conn.h>
+
+/**
+ * @brief Start advertising
+ *
+ * High duty cycle directed advertising to the bonded peer is tried first, then fast
+ * undirected advertising for CONFIG_BT_NUS_ADV_FAST_TIMEOUT and slow advertising
+ * afterwards. The same sequence is restarted on every disconnection.
+ * Bonds must have been loaded before calling this function. Advertising that fails
+ * to start, for instance while no connection object is free, is retried with an
+ * exponential backoff.
+ *
+ * @return 0 on success, negative error code if the first attempt failed
+ */
+int advertising_start(void);
+
+/**
+ * @brief Notify that a request has been received. Reports the disconnect to first request latency
+ *	  when the request comes from the peer that disconnected last
+ *
+ * @param conn Connection the request was received from
+ */
+void advertising_request_received(struct bt_conn *conn);
+
+#endif /* ADVERTISING_H_ */
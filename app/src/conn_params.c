@@ -0,0 +1,211 @@
+/** @file
+ *  @brief Connection parameters policy
+ *
+ *  Short connection interval while a transaction is in progress, long interval
+ *  with slave latency when the link has been idle for CONFIG_BT_NUS_CONN_PARAMS_IDLE_TIMEOUT.
+ *  A request waiting for the user keeps the link fast, so the response goes out as soon
+ *  as it is confirmed.
+ */
+#include "conn_params.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(conn_params);
+
+/* Intervals in 1.25 ms units, supervision timeout in 10 ms units */
+#define FAST_INTERVAL_MIN 6	/* 7.5 ms */
+#define FAST_INTERVAL_MAX 12	/* 15 ms */
+#define FAST_LATENCY 0
+#define SLOW_INTERVAL_MIN 80	/* 100 ms */
+#define SLOW_INTERVAL_MAX 160	/* 200 ms */
+#define SLOW_LATENCY 4
+#define SUPERVISION_TIMEOUT 600	/* 6 s */
+
+#define IDLE_TIMEOUT K_MSEC(CONFIG_BT_NUS_CONN_PARAMS_IDLE_TIMEOUT)
+/* A request without response after this time is considered abandoned */
+#define REQUEST_MAX_MS (CONFIG_BT_NUS_CONFIRM_TIMEOUT * MSEC_PER_SEC + \
+			CONFIG_BT_NUS_CONN_PARAMS_IDLE_TIMEOUT)
+
+static const struct bt_le_conn_param fast_param =
+	BT_LE_CONN_PARAM_INIT(FAST_INTERVAL_MIN, FAST_INTERVAL_MAX, FAST_LATENCY, SUPERVISION_TIMEOUT);
+static const struct bt_le_conn_param slow_param =
+	BT_LE_CONN_PARAM_INIT(SLOW_INTERVAL_MIN, SLOW_INTERVAL_MAX, SLOW_LATENCY, SUPERVISION_TIMEOUT);
+
+/* Policy state of each connection */
+struct conn_policy {
+	struct bt_conn *conn;
+	bool fast_requested;
+	/* Current connection parameters, updated by the stack */
+	uint16_t interval;
+	uint16_t latency;
+	uint32_t request_start;
+	bool request_pending;
+	/* Time spent waiting for the user during the current request */
+	uint32_t confirm_start;
+	uint32_t confirm_ms;
+	bool confirming;
+	struct k_work_delayable idle_work;
+};
+
+static struct conn_policy policies[CONFIG_BT_MAX_CONN];
+
+static struct conn_policy *policy_get(struct bt_conn *conn)
+{
+	struct conn_policy *policy = &policies[bt_conn_index(conn)];
+
+	return (policy->conn == conn) ? policy : NULL;
+}
+
+static void request_param(struct conn_policy *policy, const struct bt_le_conn_param *param)
+{
+	int err;
+
+	err = bt_conn_le_param_update(policy->conn, param);
+	if (err && (err != -EALREADY)) {
+		LOG_WRN("Connection parameters update failed (err %d)", err);
+	}
+}
+
+static void idle_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct conn_policy *policy = CONTAINER_OF(dwork, struct conn_policy, idle_work);
+
+	if (!policy->conn || !policy->fast_requested) {
+		return;
+	}
+
+	/* The response to a pending request re-arms the timer */
+	if (policy->request_pending && (k_uptime_get_32() - policy->request_start < REQUEST_MAX_MS)) {
+		k_work_reschedule(&policy->idle_work, IDLE_TIMEOUT);
+		return;
+	}
+
+	LOG_DBG("Link idle, requesting slow connection interval");
+	policy->fast_requested = false;
+	request_param(policy, &slow_param);
+}
+
+void conn_params_request_start(struct bt_conn *conn)
+{
+	struct conn_policy *policy = policy_get(conn);
+
+	if (!policy) {
+		return;
+	}
+
+	policy->request_start = k_uptime_get_32();
+	policy->request_pending = true;
+	policy->confirm_ms = 0;
+	policy->confirming = false;
+
+	if (!policy->fast_requested) {
+		LOG_DBG("Request started, requesting fast connection interval");
+		policy->fast_requested = true;
+		request_param(policy, &fast_param);
+	}
+
+	k_work_reschedule(&policy->idle_work, IDLE_TIMEOUT);
+}
+
+void conn_params_response_sent(struct bt_conn *conn)
+{
+	struct conn_policy *policy = policy_get(conn);
+
+	if (!policy || !policy->request_pending) {
+		return;
+	}
+
+	policy->request_pending = false;
+	conn_params_confirm_end(conn);
+
+	/* Interval is in 1.25 ms units. The wait for the user is not part of the round trip */
+	LOG_INF("Round trip %u ms (interval %u.%02u ms, latency %u), %u ms waiting for the user",
+		k_uptime_get_32() - policy->request_start - policy->confirm_ms,
+		(policy->interval * 5U) / 4U, ((policy->interval * 125U) % 100U),
+		policy->latency, policy->confirm_ms);
+
+	k_work_reschedule(&policy->idle_work, IDLE_TIMEOUT);
+}
+
+void conn_params_confirm_start(struct bt_conn *conn)
+{
+	struct conn_policy *policy = policy_get(conn);
+
+	if (!policy || !policy->request_pending || policy->confirming) {
+		return;
+	}
+
+	policy->confirm_start = k_uptime_get_32();
+	policy->confirming = true;
+}
+
+void conn_params_confirm_end(struct bt_conn *conn)
+{
+	struct conn_policy *policy = policy_get(conn);
+
+	if (!policy || !policy->confirming) {
+		return;
+	}
+
+	policy->confirm_ms += k_uptime_get_32() - policy->confirm_start;
+	policy->confirming = false;
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct bt_conn_info info;
+	struct conn_policy *policy = &policies[bt_conn_index(conn)];
+
+	if (err) {
+		return;
+	}
+
+	policy->conn = bt_conn_ref(conn);
+	policy->fast_requested = true;
+	policy->request_pending = false;
+	policy->confirming = false;
+	k_work_init_delayable(&policy->idle_work, idle_work_handler);
+
+	if (!bt_conn_get_info(conn, &info)) {
+		policy->interval = info.le.interval;
+		policy->latency = info.le.latency;
+	}
+
+	/* Fall back to the slow interval once service discovery is over */
+	k_work_reschedule(&policy->idle_work, IDLE_TIMEOUT);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct conn_policy *policy = policy_get(conn);
+
+	if (!policy) {
+		return;
+	}
+
+	k_work_cancel_delayable(&policy->idle_work);
+	bt_conn_unref(policy->conn);
+	policy->conn = NULL;
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	struct conn_policy *policy = policy_get(conn);
+
+	if (!policy) {
+		return;
+	}
+
+	policy->interval = interval;
+	policy->latency = latency;
+
+	LOG_INF("Connection parameters updated: interval %u.%02u ms, latency %u, timeout %u ms",
+		(interval * 5U) / 4U, ((interval * 125U) % 100U), latency, timeout * 10U);
+}
+
+BT_CONN_CB_DEFINE(conn_params_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+};
@@ -0,0 +1,47 @@
+#ifndef CONN_PARAMS_H_
+#define CONN_PARAMS_H_
+
+#include <zephyr.h>
+#include <bluetooth/conn.h>
+
+#if defined(CONFIG_BT_NUS_CONN_PARAMS_POLICY)
+
+/**
+ * @brief Notify that a request frame has started. Requests the short connection interval
+ *
+ * @param conn Connection the request was received from
+ */
+void conn_params_request_start(struct bt_conn *conn);
+
+/**
+ * @brief Notify that the response to the current request has been sent. Logs the round trip time
+ *
+ * @param conn Connection the response was sent to
+ */
+void conn_params_response_sent(struct bt_conn *conn);
+
+/**
+ * @brief Notify that the current request waits for the user to confirm it. The link stays
+ *	  fast and the wait is left out of the round trip time
+ *
+ * @param conn Connection the request was received from
+ */
+void conn_params_confirm_start(struct bt_conn *conn);
+
+/**
+ * @brief Notify that the user has answered, or that the confirmation has timed out
+ *
+ * @param conn Connection the request was received from
+ */
+void conn_params_confirm_end(struct bt_conn *conn);
+
+#else
+
+static inline void conn_params_request_start(struct bt_conn *conn) {}
+static inline void conn_params_response_sent(struct bt_conn *conn) {}
+static inline void conn_params_confirm_start(struct bt_conn *conn) {}
+static inline void conn_params_confirm_end(struct bt_conn *conn) {}
+
+#endif /* CONFIG_BT_NUS_CONN_PARAMS_POLICY */
+
+#endif /* CONN_PARAMS_H_ */
@@ -0,0 +1,99 @@
+/** @file
+ *  @brief Deferred console output
+ */
+#include "console_out.h"
+
+#include <sys/printk.h>
+#include <sys/ring_buffer.h>
+#include <stdarg.h>
+
+#define CONSOLE_OUT_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+
+RING_BUF_DECLARE(console_out_ring, CONFIG_BT_NUS_CONSOLE_OUT_BUF_SIZE);
+static struct k_spinlock console_out_lock;
+static K_SEM_DEFINE(console_out_sem, 0, 1);
+
+static struct console_out_stats stats;
+/* Dropped messages not reported yet */
+static uint32_t dropped_unreported;
+
+void console_out_printf(const char *fmt, ...)
+{
+	char msg[CONFIG_BT_NUS_CONSOLE_OUT_MSG_MAX];
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintk(msg, sizeof(msg), fmt, args);
+	va_end(args);
+
+	if (len < 0) {
+		return;
+	}
+	len = MIN(len, sizeof(msg) - 1);
+
+	k_spinlock_key_t key = k_spin_lock(&console_out_lock);
+
+	/* Messages are queued whole or not at all */
+	if (ring_buf_space_get(&console_out_ring) < len) {
+		stats.dropped++;
+		dropped_unreported++;
+	} else {
+		ring_buf_put(&console_out_ring, (uint8_t *)msg, len);
+		stats.messages++;
+		stats.max_used = MAX(stats.max_used,
+				     CONFIG_BT_NUS_CONSOLE_OUT_BUF_SIZE -
+				     ring_buf_space_get(&console_out_ring));
+	}
+
+	k_spin_unlock(&console_out_lock, key);
+
+	k_sem_give(&console_out_sem);
+}
+
+void console_out_stats_get(struct console_out_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&console_out_lock);
+
+	*out = stats;
+
+	k_spin_unlock(&console_out_lock, key);
+}
+
+static void console_out_thread(void)
+{
+	char chunk[64];
+
+	for (;;) {
+		k_sem_take(&console_out_sem, K_FOREVER);
+
+		for (;;) {
+			uint32_t dropped;
+			uint32_t len;
+
+			k_spinlock_key_t key = k_spin_lock(&console_out_lock);
+
+			len = ring_buf_get(&console_out_ring, (uint8_t *)chunk, sizeof(chunk) - 1);
+			dropped = dropped_unreported;
+			dropped_unreported = 0;
+
+			k_spin_unlock(&console_out_lock, key);
+
+			if (len) {
+				chunk[len] = '\0';
+				printk("%s", chunk);
+			}
+
+			if (dropped) {
+				printk("[%u console messages dropped]\n", dropped);
+			}
+
+			if (!len) {
+				break;
+			}
+		}
+	}
+}
+
+K_THREAD_DEFINE(console_out_thread_id, CONFIG_BT_NUS_CONSOLE_OUT_THREAD_STACK_SIZE,
+		console_out_thread, NULL, NULL, NULL, CONSOLE_OUT_PRIORITY, 0, 0);
@@ -0,0 +1,37 @@
+#ifndef CONSOLE_OUT_H_
+#define CONSOLE_OUT_H_
+
+#include <zephyr.h>
+
+/**
+ * @brief Console output statistics
+ */
+struct console_out_stats {
+	/** Messages queued */
+	uint32_t messages;
+	/** Messages dropped because the queue was full */
+	uint32_t dropped;
+	/** Highest number of bytes waiting in the queue */
+	uint32_t max_used;
+};
+
+/**
+ * @brief Print a message on the console without blocking
+ *
+ * The message is formatted into a queue and printed by a low priority thread, so
+ * slow console output does not delay request processing. If the queue is full the
+ * message is dropped and counted. Messages longer than CONFIG_BT_NUS_CONSOLE_OUT_MSG_MAX
+ * are truncated. Can be called from any context.
+ *
+ * @param fmt printf-style format
+ */
+__printf_like(1, 2) void console_out_printf(const char *fmt, ...);
+
+/**
+ * @brief Get the console output statistics
+ *
+ * @param stats Statistics
+ */
+void console_out_stats_get(struct console_out_stats *stats);
+
+#endif /* CONSOLE_OUT_H_ */
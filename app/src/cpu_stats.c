@@ -0,0 +1,243 @@
+/** @file
+ *  @brief Per-thread CPU usage reporting
+ *
+ *  The execution cycles the kernel accounts to every thread with
+ *  CONFIG_THREAD_RUNTIME_STATS are sampled every CONFIG_BT_NUS_CPU_STATS_SAMPLE_MS.
+ *  The cycles of the last CONFIG_BT_NUS_CPU_STATS_WINDOW sample periods are kept
+ *  for every thread, so the usage during a burst of requests can be told apart
+ *  from the usage since boot.
+ *
+ *  Interrupts are accounted to the thread they interrupt, and the time of the idle
+ *  thread is the time the SoC spends sleeping. Threads that exit are removed from
+ *  the window, so the shares of the others stay relative to the running threads.
+ */
+#include "cpu_stats.h"
+#include "console_out.h"
+
+#include <string.h>
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(cpu_stats);
+
+#define CPU_STATS_THREADS_MAX 16
+
+struct thread_usage {
+	k_tid_t tid;
+	char name[CONFIG_THREAD_MAX_NAME_LEN];
+	bool idle;
+	bool seen;
+	/* The thread has been sampled once, so the next sample gives a period */
+	bool primed;
+	/* Execution cycles since the thread started at the last sample */
+	uint64_t cycles;
+	/* Execution cycles of the sample periods of the window, and their sum */
+	uint32_t period_cycles[CONFIG_BT_NUS_CPU_STATS_WINDOW];
+	uint64_t window_cycles;
+};
+
+static struct thread_usage threads[CPU_STATS_THREADS_MAX];
+/* Sum over all the threads */
+static uint64_t total_cycles;
+static uint32_t total_period_cycles[CONFIG_BT_NUS_CPU_STATS_WINDOW];
+static uint64_t total_window_cycles;
+/* Sample period being filled in the window, and the number of sample periods taken */
+static int period;
+static uint32_t periods;
+static uint32_t threads_dropped;
+
+static K_MUTEX_DEFINE(cpu_stats_mutex);
+
+static void cpu_stats_sample(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(cpu_stats_work, cpu_stats_sample);
+
+static struct thread_usage *thread_usage_get(k_tid_t tid)
+{
+	struct thread_usage *free_slot = NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+		if (threads[i].tid == tid) {
+			return &threads[i];
+		}
+		if (!threads[i].tid && !free_slot) {
+			free_slot = &threads[i];
+		}
+	}
+
+	if (free_slot) {
+		const char *name = k_thread_name_get(tid);
+
+		memset(free_slot, 0, sizeof(*free_slot));
+		free_slot->tid = tid;
+		free_slot->idle = (k_thread_priority_get(tid) == K_IDLE_PRIO);
+		strncpy(free_slot->name, (name && name[0]) ? name : "?",
+			sizeof(free_slot->name) - 1);
+	}
+
+	return free_slot;
+}
+
+static void thread_sample(const struct k_thread *thread, void *user_data)
+{
+	struct thread_usage *usage = thread_usage_get((k_tid_t)thread);
+	k_thread_runtime_stats_t stats;
+	uint32_t delta;
+
+	if (!usage) {
+		threads_dropped++;
+		return;
+	}
+
+	if (k_thread_runtime_stats_get((k_tid_t)thread, &stats)) {
+		return;
+	}
+
+	/* The first sample of a thread only sets its starting point, otherwise the whole
+	 * lifetime of a thread started during the window would count in a single period
+	 */
+	delta = usage->primed ? (uint32_t)(stats.execution_cycles - usage->cycles) : 0;
+
+	usage->seen = true;
+	usage->primed = true;
+	usage->cycles = stats.execution_cycles;
+	usage->window_cycles -= usage->period_cycles[period];
+	usage->window_cycles += delta;
+	usage->period_cycles[period] = delta;
+	total_cycles += stats.execution_cycles;
+	total_period_cycles[period] += delta;
+}
+
+/* Remove a thread that has exited from the window totals and free its slot */
+static void thread_usage_drop(struct thread_usage *usage)
+{
+	for (int i = 0; i < CONFIG_BT_NUS_CPU_STATS_WINDOW; i++) {
+		/* The current period was restarted without the thread */
+		if (i != period) {
+			total_period_cycles[i] -= usage->period_cycles[i];
+			total_window_cycles -= usage->period_cycles[i];
+		}
+	}
+
+	usage->tid = NULL;
+}
+
+static void cpu_stats_sample(struct k_work *work)
+{
+	k_mutex_lock(&cpu_stats_mutex, K_FOREVER);
+
+	total_cycles = 0;
+	total_window_cycles -= total_period_cycles[period];
+	total_period_cycles[period] = 0;
+
+	k_thread_foreach_unlocked(thread_sample, NULL);
+
+	/* Threads that have exited free their slot */
+	for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+		if (threads[i].tid && !threads[i].seen) {
+			thread_usage_drop(&threads[i]);
+		}
+		threads[i].seen = false;
+	}
+
+	total_window_cycles += total_period_cycles[period];
+	period = (period + 1) % CONFIG_BT_NUS_CPU_STATS_WINDOW;
+	periods++;
+
+	k_mutex_unlock(&cpu_stats_mutex);
+
+	k_work_reschedule(&cpu_stats_work, K_MSEC(CONFIG_BT_NUS_CPU_STATS_SAMPLE_MS));
+}
+
+/* Share of total in tenths of percent */
+static uint32_t permille(uint64_t cycles, uint64_t total)
+{
+	return total ? (uint32_t)(cycles * 1000 / total) : 0;
+}
+
+/* Length of the sliding window in ms, shorter until enough samples are taken */
+static uint32_t window_ms(void)
+{
+	uint32_t count = periods ? MIN(periods - 1, CONFIG_BT_NUS_CPU_STATS_WINDOW) : 0;
+
+	return count * CONFIG_BT_NUS_CPU_STATS_SAMPLE_MS;
+}
+
+void cpu_stats_print(void)
+{
+	uint64_t idle_boot = 0;
+	uint64_t idle_window = 0;
+	uint32_t boot;
+	uint32_t window;
+
+	k_mutex_lock(&cpu_stats_mutex, K_FOREVER);
+
+	console_out_printf("CPU usage (since boot / last %u ms):\n", window_ms());
+	for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+		struct thread_usage *usage = &threads[i];
+
+		if (!usage->tid) {
+			continue;
+		}
+
+		boot = permille(usage->cycles, total_cycles);
+		window = permille(usage->window_cycles, total_window_cycles);
+
+		console_out_printf("\t%-24s %3u.%u%% / %3u.%u%%\n", usage->name, boot / 10,
+				   boot % 10, window / 10, window % 10);
+
+		if (usage->idle) {
+			idle_boot += usage->cycles;
+			idle_window += usage->window_cycles;
+		}
+	}
+
+	if (threads_dropped) {
+		console_out_printf("%u thread samples dropped, over %u threads\n", threads_dropped,
+				   CPU_STATS_THREADS_MAX);
+	}
+
+	boot = permille(idle_boot, total_cycles);
+	window = permille(idle_window, total_window_cycles);
+	console_out_printf("Idle: %u.%u%% since boot, %u.%u%% over the last %u ms\n", boot / 10,
+			   boot % 10, window / 10, window % 10, window_ms());
+
+	k_mutex_unlock(&cpu_stats_mutex);
+}
+
+void cpu_stats_log(void)
+{
+	k_mutex_lock(&cpu_stats_mutex, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+		struct thread_usage *usage = &threads[i];
+		uint32_t window = permille(usage->window_cycles, total_window_cycles);
+
+		if (usage->tid) {
+			LOG_INF("%s: %u.%u%% CPU over the last %u ms", log_strdup(usage->name),
+				window / 10, window % 10, window_ms());
+		}
+	}
+
+	k_mutex_unlock(&cpu_stats_mutex);
+}
+
+#if CONFIG_BT_NUS_CPU_STATS_LOG_INTERVAL > 0
+static void cpu_stats_report(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(cpu_stats_report_work, cpu_stats_report);
+
+static void cpu_stats_report(struct k_work *work)
+{
+	cpu_stats_log();
+	k_work_reschedule(&cpu_stats_report_work, K_SECONDS(CONFIG_BT_NUS_CPU_STATS_LOG_INTERVAL));
+}
+#endif
+
+void cpu_stats_init(void)
+{
+	k_work_reschedule(&cpu_stats_work, K_NO_WAIT);
+
+#if CONFIG_BT_NUS_CPU_STATS_LOG_INTERVAL > 0
+	k_work_reschedule(&cpu_stats_report_work, K_SECONDS(CONFIG_BT_NUS_CPU_STATS_LOG_INTERVAL));
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef CPU_STATS_H_
+#define CPU_STATS_H_
+
+#include <zephyr.h>
+
+#if defined(CONFIG_BT_NUS_CPU_STATS)
+
+/**
+ * @brief Start sampling the CPU usage of the threads and the periodic CPU report
+ */
+void cpu_stats_init(void);
+
+/**
+ * @brief Print the CPU usage of every thread since boot and over the sliding window on the
+ *	  console
+ */
+void cpu_stats_print(void);
+
+/**
+ * @brief Log the CPU usage of every thread over the sliding window
+ */
+void cpu_stats_log(void);
+
+#else
+
+static inline void cpu_stats_init(void)
+{
+}
+
+static inline void cpu_stats_print(void)
+{
+}
+
+static inline void cpu_stats_log(void)
+{
+}
+
+#endif /* CONFIG_BT_NUS_CPU_STATS */
+
+#endif /* CPU_STATS_H_ */
@@ -0,0 +1,138 @@
+/** @file
+ *  @brief Credential GATT service
+ *
+ *  Separate characteristics for requests (write without response), responses (notify)
+ *  and status/capabilities (read). Requests and responses use the same JSON protocol as NUS.
+ */
+#include "credential_service.h"
+#include "storage_manager.h"
+#include "session.h"
+#include "latency.h"
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include <stdio.h>
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(credential_service);
+
+#define PROTOCOL_VERSION 1
+
+#define STATUS_MSG "{\"ver\":%d,\"url\":%d,\"user\":%d,\"pwd\":%d,\"max\":%d,\"stored\":%d,\"batch\":%d}"
+#define STATUS_MSG_SIZE (sizeof(STATUS_MSG) + 20)
+
+#define BT_UUID_CRED          BT_UUID_DECLARE_128(BT_UUID_CRED_VAL)
+#define BT_UUID_CRED_REQUEST  BT_UUID_DECLARE_128(BT_UUID_CRED_REQUEST_VAL)
+#define BT_UUID_CRED_RESPONSE BT_UUID_DECLARE_128(BT_UUID_CRED_RESPONSE_VAL)
+#define BT_UUID_CRED_STATUS   BT_UUID_DECLARE_128(BT_UUID_CRED_STATUS_VAL)
+#define BT_UUID_CRED_DIAGNOSTICS BT_UUID_DECLARE_128(BT_UUID_CRED_DIAGNOSTICS_VAL)
+
+/* Same access rules as NUS: the service must not be a way around its security */
+#if defined(CONFIG_BT_NUS_AUTHEN)
+#define CRED_PERM_READ  BT_GATT_PERM_READ_AUTHEN
+#define CRED_PERM_WRITE BT_GATT_PERM_WRITE_AUTHEN
+#else
+#define CRED_PERM_READ  BT_GATT_PERM_READ
+#define CRED_PERM_WRITE BT_GATT_PERM_WRITE
+#endif
+
+static const struct credential_service_cb *cb;
+
+static ssize_t on_request_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (cb && cb->received) {
+		cb->received(conn, buf, len);
+	}
+
+	return len;
+}
+
+static ssize_t on_status_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			      void *buf, uint16_t len, uint16_t offset)
+{
+	char status[STATUS_MSG_SIZE];
+	int status_len;
+
+	status_len = snprintf(status, sizeof(status), STATUS_MSG, PROTOCOL_VERSION,
+			      URL_SIZE, USERNAME_SIZE, PWD_SIZE, MAX_STORABLE_PWD,
+			      getNumPwd(), BATCH_MAX_SIZE);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, status, status_len);
+}
+
+#if defined(CONFIG_BT_NUS_LATENCY_TRACE)
+static ssize_t on_diagnostics_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				   void *buf, uint16_t len, uint16_t offset)
+{
+	uint8_t diagnostics[LATENCY_ENCODED_SIZE];
+	size_t diagnostics_len = latency_encode(diagnostics);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, diagnostics, diagnostics_len);
+}
+#endif
+
+static void on_response_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	LOG_DBG("Response notifications %s", (value == BT_GATT_CCC_NOTIFY) ? "enabled" : "disabled");
+}
+
+BT_GATT_SERVICE_DEFINE(credential_svc,
+	BT_GATT_PRIMARY_SERVICE(BT_UUID_CRED),
+	BT_GATT_CHARACTERISTIC(BT_UUID_CRED_REQUEST,
+			       BT_GATT_CHRC_WRITE_WITHOUT_RESP | BT_GATT_CHRC_WRITE,
+			       CRED_PERM_WRITE, NULL, on_request_write, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_CRED_RESPONSE,
+			       BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(on_response_ccc_changed, CRED_PERM_READ | CRED_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_CRED_STATUS,
+			       BT_GATT_CHRC_READ,
+			       CRED_PERM_READ, on_status_read, NULL, NULL),
+#if defined(CONFIG_BT_NUS_LATENCY_TRACE)
+	BT_GATT_CHARACTERISTIC(BT_UUID_CRED_DIAGNOSTICS,
+			       BT_GATT_CHRC_READ,
+			       CRED_PERM_READ, on_diagnostics_read, NULL, NULL),
+#endif
+);
+
+/* Value attribute of the response characteristic */
+#define RESPONSE_ATTR (&credential_svc.attrs[4])
+
+static void on_sent(struct bt_conn *conn, void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	if (cb && cb->sent) {
+		cb->sent(conn);
+	}
+}
+
+int credential_service_init(const struct credential_service_cb *callbacks)
+{
+	cb = callbacks;
+
+	return 0;
+}
+
+int credential_service_send(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	struct bt_gatt_notify_params params = {
+		.attr = RESPONSE_ATTR,
+		.data = data,
+		.len = len,
+		.func = on_sent,
+	};
+
+	if (!bt_gatt_is_subscribed(conn, RESPONSE_ATTR, BT_GATT_CCC_NOTIFY)) {
+		return -EINVAL;
+	}
+
+	return bt_gatt_notify_cb(conn, &params);
+}
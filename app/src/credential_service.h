@@ -0,0 +1,73 @@
+#ifndef CREDENTIAL_SERVICE_H_
+#define CREDENTIAL_SERVICE_H_
+
+#include <zephyr.h>
+#include <bluetooth/conn.h>
+
+/** @brief UUID of the credential service */
+#define BT_UUID_CRED_VAL \
+	BT_UUID_128_ENCODE(0x8a4c0001, 0x6b3e, 0x4a6f, 0x9c1d, 0x2f6e5a7b3c10)
+
+/** @brief UUID of the request characteristic (write without response) */
+#define BT_UUID_CRED_REQUEST_VAL \
+	BT_UUID_128_ENCODE(0x8a4c0002, 0x6b3e, 0x4a6f, 0x9c1d, 0x2f6e5a7b3c10)
+
+/** @brief UUID of the response characteristic (notify) */
+#define BT_UUID_CRED_RESPONSE_VAL \
+	BT_UUID_128_ENCODE(0x8a4c0003, 0x6b3e, 0x4a6f, 0x9c1d, 0x2f6e5a7b3c10)
+
+/** @brief UUID of the status and capabilities characteristic (read) */
+#define BT_UUID_CRED_STATUS_VAL \
+	BT_UUID_128_ENCODE(0x8a4c0004, 0x6b3e, 0x4a6f, 0x9c1d, 0x2f6e5a7b3c10)
+
+/** @brief UUID of the request latency diagnostics characteristic (read) */
+#define BT_UUID_CRED_DIAGNOSTICS_VAL \
+	BT_UUID_128_ENCODE(0x8a4c0005, 0x6b3e, 0x4a6f, 0x9c1d, 0x2f6e5a7b3c10)
+
+/**
+ * @brief Credential service callbacks, same semantics as the NUS ones
+ */
+struct credential_service_cb {
+	/** Request fragment written by a client */
+	void (*received)(struct bt_conn *conn, const uint8_t *const data, uint16_t len);
+	/** Response notification sent */
+	void (*sent)(struct bt_conn *conn);
+};
+
+#if defined(CONFIG_BT_NUS_CREDENTIAL_SERVICE)
+
+/**
+ * @brief Initialize the credential service
+ *
+ * @param callbacks Struct with the callbacks
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int credential_service_init(const struct credential_service_cb *callbacks);
+
+/**
+ * @brief Send a response notification. It must fit in the ATT MTU
+ *
+ * @param conn Connection to notify
+ * @param data Notification payload
+ * @param len  Notification length
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int credential_service_send(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+#else
+
+static inline int credential_service_init(const struct credential_service_cb *callbacks)
+{
+	return 0;
+}
+
+static inline int credential_service_send(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	return -ENOTSUP;
+}
+
+#endif /* CONFIG_BT_NUS_CREDENTIAL_SERVICE */
+
+#endif /* CREDENTIAL_SERVICE_H_ */
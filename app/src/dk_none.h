@@ -0,0 +1,54 @@
+#ifndef DK_NONE_H_
+#define DK_NONE_H_
+
+/* Stand-in for the DK buttons and LEDs library on targets without them, such as the
+ * simulated ones: the LEDs do nothing and the buttons are never pressed
+ */
+
+#include <zephyr.h>
+
+#define DK_NO_LEDS_MSK  (0)
+#define DK_LED1         0
+#define DK_LED2         1
+#define DK_LED3         2
+#define DK_LED4         3
+#define DK_ALL_LEDS_MSK (BIT(DK_LED1) | BIT(DK_LED2) | BIT(DK_LED3) | BIT(DK_LED4))
+
+#define DK_BTN1_MSK BIT(0)
+#define DK_BTN2_MSK BIT(1)
+#define DK_BTN3_MSK BIT(2)
+#define DK_BTN4_MSK BIT(3)
+
+typedef void (*button_handler_t)(uint32_t button_state, uint32_t has_changed);
+
+static inline int dk_buttons_init(button_handler_t button_handler)
+{
+	return 0;
+}
+
+static inline int dk_leds_init(void)
+{
+	return 0;
+}
+
+static inline int dk_set_leds_state(uint32_t leds_on_mask, uint32_t leds_off_mask)
+{
+	return 0;
+}
+
+static inline int dk_set_led(uint8_t led_idx, uint32_t val)
+{
+	return 0;
+}
+
+static inline int dk_set_led_on(uint8_t led_idx)
+{
+	return 0;
+}
+
+static inline int dk_set_led_off(uint8_t led_idx)
+{
+	return 0;
+}
+
+#endif /* DK_NONE_H_ */
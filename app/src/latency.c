@@ -0,0 +1,140 @@
+/** @file
+ *  @brief Per-stage request latency histograms
+ */
+#include "latency.h"
+#include "console_out.h"
+
+#include <sys/byteorder.h>
+#include <stdio.h>
+
+struct latency_hist {
+	uint32_t count;
+	uint64_t total_us;
+	uint32_t max_us;
+	uint32_t buckets[LATENCY_BUCKETS];
+};
+
+static struct latency_hist hists[LATENCY_STAGE_COUNT];
+
+static const char *const stage_names[LATENCY_STAGE_COUNT] = {
+	[LATENCY_REASSEMBLY] = "reassembly",
+	[LATENCY_PARSE] = "parse",
+	[LATENCY_LOOKUP] = "lookup",
+	[LATENCY_CONFIRM] = "confirm",
+	[LATENCY_SEND] = "send",
+	[LATENCY_TOTAL] = "total",
+};
+
+static bool stage_in_ms(int stage)
+{
+	return (LATENCY_MS_STAGES & BIT(stage)) != 0;
+}
+
+static void hist_add(enum latency_stage stage, uint32_t cycles)
+{
+	struct latency_hist *hist = &hists[stage];
+	uint32_t us = k_cyc_to_us_floor32(cycles);
+	uint32_t value = stage_in_ms(stage) ? us / USEC_PER_MSEC : us;
+	int bucket = value ? MIN(32 - __builtin_clz(value), LATENCY_BUCKETS - 1) : 0;
+
+	hist->count++;
+	hist->total_us += us;
+	hist->max_us = MAX(hist->max_us, us);
+	hist->buckets[bucket]++;
+}
+
+void latency_trace_start(struct latency_trace *trace, uint32_t cycles)
+{
+	/* 0 means not traced */
+	trace->start = cycles ? cycles : 1;
+	trace->last = trace->start;
+}
+
+void latency_trace_mark(struct latency_trace *trace, enum latency_stage stage)
+{
+	uint32_t now = k_cycle_get_32();
+
+	if (!trace->start) {
+		return;
+	}
+
+	hist_add(stage, now - trace->last);
+	trace->last = now;
+}
+
+void latency_trace_end(struct latency_trace *trace)
+{
+	uint32_t now = k_cycle_get_32();
+
+	if (!trace->start) {
+		return;
+	}
+
+	hist_add(LATENCY_SEND, now - trace->last);
+	hist_add(LATENCY_TOTAL, now - trace->start);
+	trace->start = 0;
+}
+
+void latency_print(void)
+{
+	char line[CONFIG_BT_NUS_CONSOLE_OUT_MSG_MAX];
+
+	for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+		const struct latency_hist *hist = &hists[i];
+		const char *unit = stage_in_ms(i) ? "ms" : "us";
+		size_t len = 0;
+
+		console_out_printf("Latency %s: %u, avg %u us, max %u us\n", stage_names[i],
+				   hist->count,
+				   hist->count ? (uint32_t)(hist->total_us / hist->count) : 0,
+				   hist->max_us);
+
+		/* Non-empty buckets, by their upper bound */
+		for (int b = 0; b < LATENCY_BUCKETS; b++) {
+			if (!hist->buckets[b]) {
+				continue;
+			}
+
+			if (b == LATENCY_BUCKETS - 1) {
+				len += snprintf(&line[len], sizeof(line) - len, "\t>=%u%s: %u",
+						1U << (b - 1), unit, hist->buckets[b]);
+			} else {
+				len += snprintf(&line[len], sizeof(line) - len, "\t<%u%s: %u",
+						1U << b, unit, hist->buckets[b]);
+			}
+			if (len > sizeof(line) - 32) {
+				console_out_printf("%s\n", line);
+				len = 0;
+			}
+		}
+		if (len) {
+			console_out_printf("%s\n", line);
+		}
+	}
+}
+
+size_t latency_encode(uint8_t *buf)
+{
+	uint8_t *p = buf;
+
+	*p++ = LATENCY_ENCODE_VERSION;
+	*p++ = LATENCY_STAGE_COUNT;
+	*p++ = LATENCY_BUCKETS;
+	*p++ = LATENCY_MS_STAGES;
+
+	for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+		const struct latency_hist *hist = &hists[i];
+
+		sys_put_le32(hist->count, p);
+		sys_put_le64(hist->total_us, &p[4]);
+		sys_put_le32(hist->max_us, &p[12]);
+		p += 16;
+
+		for (int b = 0; b < LATENCY_BUCKETS; b++) {
+			sys_put_le16(MIN(hist->buckets[b], UINT16_MAX), p);
+			p += 2;
+		}
+	}
+
+	return p - buf;
+}
@@ -0,0 +1,117 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <zephyr.h>
+
+/**
+ * @brief Stages of a request. Each one is measured from the previous stage the
+ *        request went through
+ */
+enum latency_stage {
+	/** First fragment received until the message is complete */
+	LATENCY_REASSEMBLY,
+	/** Message complete until parsed */
+	LATENCY_PARSE,
+	/** Parsed until the storage lookup is done, including the wait to be served */
+	LATENCY_LOOKUP,
+	/** Until the user confirmed or rejected the request */
+	LATENCY_CONFIRM,
+	/** Until the response is handed over to be sent */
+	LATENCY_SEND,
+	/** First fragment received until the response is handed over to be sent */
+	LATENCY_TOTAL,
+	LATENCY_STAGE_COUNT
+};
+
+/**
+ * Histogram buckets: bucket 0 counts times under 1 unit, bucket i times in [2^(i-1), 2^i)
+ * units. The unit is the microsecond, or the millisecond for the stages in LATENCY_MS_STAGES
+ */
+#define LATENCY_BUCKETS 24
+
+/** Stages that include the wait for the user, in seconds: their buckets are in ms */
+#define LATENCY_MS_STAGES (BIT(LATENCY_CONFIRM) | BIT(LATENCY_TOTAL))
+
+/** Version of the latency_encode() format */
+#define LATENCY_ENCODE_VERSION 2
+
+/** Size of the latency_encode() output */
+#define LATENCY_ENCODED_SIZE (4 + LATENCY_STAGE_COUNT * (16 + 2 * LATENCY_BUCKETS))
+
+#if defined(CONFIG_BT_NUS_LATENCY_TRACE)
+
+/**
+ * @brief Timestamps of the request being traced
+ */
+struct latency_trace {
+	/** Cycle counter when the first fragment was received, 0 if not traced */
+	uint32_t start;
+	/** Cycle counter at the end of the previous stage */
+	uint32_t last;
+};
+
+/**
+ * @brief Start tracing a request
+ *
+ * @param trace  Trace of the request
+ * @param cycles Cycle counter when the first fragment was received
+ */
+void latency_trace_start(struct latency_trace *trace, uint32_t cycles);
+
+/**
+ * @brief Record the end of a stage. Does nothing if the request is not traced
+ *
+ * @param trace Trace of the request
+ * @param stage Stage that has ended
+ */
+void latency_trace_mark(struct latency_trace *trace, enum latency_stage stage);
+
+/**
+ * @brief Record the end of LATENCY_SEND and LATENCY_TOTAL and stop tracing the request
+ *
+ * @param trace Trace of the request
+ */
+void latency_trace_end(struct latency_trace *trace);
+
+/**
+ * @brief Print the histograms on the console
+ */
+void latency_print(void);
+
+/**
+ * @brief Encode the histograms for the diagnostics characteristic
+ *
+ * Little endian: version, stage count and bucket count (1 byte each) and the
+ * LATENCY_MS_STAGES mask, then for every stage the count (4 bytes), the total in us
+ * (8 bytes), the maximum in us (4 bytes) and the bucket counts (2 bytes each, saturated).
+ *
+ * @param buf Buffer of at least LATENCY_ENCODED_SIZE bytes
+ *
+ * @return Number of bytes written
+ */
+size_t latency_encode(uint8_t *buf);
+
+#else
+
+struct latency_trace {
+};
+
+static inline void latency_trace_start(struct latency_trace *trace, uint32_t cycles)
+{
+}
+
+static inline void latency_trace_mark(struct latency_trace *trace, enum latency_stage stage)
+{
+}
+
+static inline void latency_trace_end(struct latency_trace *trace)
+{
+}
+
+static inline void latency_print(void)
+{
+}
+
+#endif /* CONFIG_BT_NUS_LATENCY_TRACE */
+
+#endif /* LATENCY_H_ */
@@ -0,0 +1,69 @@
+/** @file
+ *  @brief Line assembler on a ring buffer, for the UART console
+ */
+#include "line_assembler.h"
+
+#include <errno.h>
+
+void line_assembler_init(struct line_assembler *la, uint8_t *buf, size_t size)
+{
+	la->buf = buf;
+	la->mask = size - 1;
+	la->head = 0;
+	la->tail = 0;
+	la->scan = 0;
+	la->discard = false;
+}
+
+size_t line_assembler_put(struct line_assembler *la, const uint8_t *data, size_t len)
+{
+	size_t space = (la->mask + 1) - (la->head - la->tail);
+	size_t stored = (len < space) ? len : space;
+
+	for (size_t i = 0; i < stored; i++) {
+		la->buf[la->head++ & la->mask] = data[i];
+	}
+
+	return stored;
+}
+
+int line_assembler_get(struct line_assembler *la, char *line, size_t size)
+{
+	while (la->scan != la->head) {
+		uint8_t c = la->buf[la->scan++ & la->mask];
+
+		if ((c != '\r') && (c != '\n')) {
+			/* Drop the line as soon as it cannot fit, so the ring buffer never fills up */
+			if ((la->scan - la->tail) >= size) {
+				la->discard = true;
+			}
+
+			if (la->discard) {
+				la->tail = la->scan;
+			}
+			continue;
+		}
+
+		if (la->discard) {
+			la->discard = false;
+			la->tail = la->scan;
+			return -E2BIG;
+		}
+
+		uint32_t len = la->scan - 1 - la->tail;
+
+		for (uint32_t i = 0; i < len; i++) {
+			line[i] = la->buf[la->tail++ & la->mask];
+		}
+		line[len] = '\0';
+
+		/* Skip the terminator */
+		la->tail = la->scan;
+
+		if (len > 0) {
+			return len;
+		}
+	}
+
+	return -EAGAIN;
+}
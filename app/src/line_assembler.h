@@ -0,0 +1,61 @@
+#ifndef LINE_ASSEMBLER_H_
+#define LINE_ASSEMBLER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Assembles lines from data received in blocks of any size
+ *
+ * Data is copied into a ring buffer and whole lines, terminated by CR or LF, are
+ * extracted from it. Empty lines are skipped, so CRLF yields a single line.
+ * Lines longer than the line buffer given to line_assembler_get() are discarded.
+ * Not thread safe: put and get are expected to be called from the same thread.
+ */
+struct line_assembler {
+	/** Ring buffer storage. Its size must be a power of two */
+	uint8_t *buf;
+	uint32_t mask;
+	/** Free running write, read and scan positions */
+	uint32_t head;
+	uint32_t tail;
+	uint32_t scan;
+	/** The line being received is too long. It is dropped up to its terminator */
+	bool discard;
+};
+
+/**
+ * @brief Initialize a line assembler
+ *
+ * @param la   Line assembler
+ * @param buf  Ring buffer storage
+ * @param size Size of the storage, power of two
+ */
+void line_assembler_init(struct line_assembler *la, uint8_t *buf, size_t size);
+
+/**
+ * @brief Add received data
+ *
+ * @param la   Line assembler
+ * @param data Data
+ * @param len  Length of the data
+ *
+ * @return Number of bytes stored, less than len if the ring buffer is full. Getting the
+ *         whole lines frees space for the rest
+ */
+size_t line_assembler_put(struct line_assembler *la, const uint8_t *data, size_t len);
+
+/**
+ * @brief Get the next whole line, without its terminator
+ *
+ * @param la   Line assembler
+ * @param line Buffer for the line, NUL terminated
+ * @param size Size of the buffer
+ *
+ * @return Length of the line, -EAGAIN if no whole line has been received,
+ *         -E2BIG if a line longer than the buffer has been discarded
+ */
+int line_assembler_get(struct line_assembler *la, char *line, size_t size);
+
+#endif /* LINE_ASSEMBLER_H_ */
@@ -9,6 +9,18 @@
  */
 #include "uart_async_adapter.h"
 #include "storage_manager.h"
+#include "response_sender.h"
+#include "conn_params.h"
+#include "session.h"
+#include "advertising.h"
+#include "credential_service.h"
+#include "line_assembler.h"
+#include "msg_assembler.h"
+#include "request_parser.h"
+#include "console_out.h"
+#include "latency.h"
+#include "mem_diag.h"
+#include "cpu_stats.h"
 
 #include <zephyr/types.h>
 #include <zephyr.h>
@@ -25,15 +37,19 @@
 
 #include <bluetooth/services/nus.h>
 
+#if defined(CONFIG_DK_LIBRARY)
 #include <dk_buttons_and_leds.h>
+#else
+#include "dk_none.h"
+#endif
 
 #include <settings/settings.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <logging/log.h>
 
-#include <cJSON.h>
 #include <cJSON_os.h>
 
 #define LOG_MODULE_NAME peripheral_uart
@@ -42,24 +58,29 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 #define STACKSIZE CONFIG_BT_NUS_THREAD_STACK_SIZE
 #define PRIORITY 7
 
-#define DEVICE_NAME CONFIG_BT_DEVICE_NAME
-#define DEVICE_NAME_LEN	(sizeof(DEVICE_NAME) - 1)
-
 #define RUN_STATUS_LED DK_LED1
 #define RUN_LED_BLINK_INTERVAL 1000
+#define RUN_LED_PENDING_BLINK_INTERVAL 200
 
 #define CON_STATUS_LED DK_LED2
 
 #define KEY_PASSKEY_ACCEPT DK_BTN1_MSK
 #define KEY_PASSKEY_REJECT DK_BTN2_MSK
+#define KEY_APPROVAL_END DK_BTN3_MSK
+
+#define KEY_REQUEST_ACCEPT DK_BTN1_MSK
+#define KEY_REQUEST_REJECT DK_BTN2_MSK
+
+#define CONFIRM_PROMPT "To confirm/reject, type Y/n or press Button 1/Button 2\n"
 
 #define UART_BUF_SIZE CONFIG_BT_NUS_UART_BUFFER_SIZE
 #define UART_WAIT_FOR_BUF_DELAY K_MSEC(50)
 #define UART_WAIT_FOR_RX CONFIG_BT_NUS_UART_RX_WAIT_TIME
 
+#define WELCOME_MSG "Starting BH Password Manager\r\n"
+
 static K_SEM_DEFINE(ble_init_ok, 0, 1);
 
-static struct bt_conn *current_conn;
 static struct bt_conn *auth_conn;
 
 static const struct device *uart;
@@ -71,18 +92,8 @@ struct uart_data_t {
 	uint16_t len;
 };
 
-static K_FIFO_DEFINE(fifo_uart_tx_data);
 static K_FIFO_DEFINE(fifo_uart_rx_data);
 
-static const struct bt_data ad[] = {
-	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
-	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
-};
-
-static const struct bt_data sd[] = {
-	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_NUS_VAL),
-};
-
 #if CONFIG_BT_NUS_UART_ASYNC_ADAPTER
 UART_ASYNC_ADAPTER_INST_DEFINE(async_adapter);
 #else
@@ -95,24 +106,279 @@ static const struct device *const async_adapter;
 #define ERR_WRONG_FORMAT "{\"err\":\"wrong msg format\"}"
 #define ERR_COMPLETE_STORAGE "{\"err\":\"storage is full\"}"
 
-struct k_sem sem;
-struct k_mutex state_mutex;
-struct TPassword pwdStruct;
+#define ERR_BUSY "{\"err\":\"busy\"}"
+
+#define BATCH_PWD_MSG "{\"i\":%d,\"pwd\":\"%s\"}"
+#define BATCH_NOT_FOUND_MSG "{\"i\":%d,\"err\":\"pwd not found\"}"
+#define BATCH_MSG_SIZE (sizeof(BATCH_PWD_MSG) + PWD_SIZE + 4)
+
+#define SEARCH_MATCH_MSG "{\"i\":%d,\"url\":\"%s\",\"user\":\"%s\"}"
+#define SEARCH_DONE_MSG "{\"err\":\"ok\",\"total\":%d}"
+#define SEARCH_MSG_SIZE (sizeof(SEARCH_MATCH_MSG) + URL_SIZE + USERNAME_SIZE + 4)
+
+/* Session whose request is being served. Only used by the main thread */
+static struct session *active_session;
+
+/* States of the request state machine. Only the main thread changes the state */
+enum CURRENT_STATE {IDLE, WAITING_GET_PWD_CONF, WAITING_STORE_PWD_CONF, WAITING_DELETE_ALL, WAITING_GET_BATCH_CONF, WAITING_DELETE_PWD, WAITING_SEARCH_CONF, STATE_COUNT};
+static enum CURRENT_STATE state = IDLE;
+
+/* Set while a request is waiting for confirmation, read by the LED work */
+static atomic_t confirmation_pending;
+/* Number of the confirmation prompt shown last, the user's answers carry it */
+static atomic_t prompt_seq;
+
+/* Events posted to the request state machine */
+enum fsm_event_type {
+	EVT_REQUEST,		/* A client has submitted a request */
+	EVT_CONFIRM,		/* The user has accepted the pending request */
+	EVT_REJECT,		/* The user has rejected the pending request */
+	EVT_TIMEOUT,		/* The deadline of the current state has expired */
+	EVT_COMMAND,		/* A console command is waiting in console_cmd */
+	EVT_DISCONNECTED,	/* A client has disconnected */
+	EVT_COUNT
+};
+
+struct fsm_event {
+	enum fsm_event_type type;
+	/* Referenced connection the event refers to, NULL if none */
+	struct bt_conn *conn;
+	/* EVT_CONFIRM and EVT_REJECT: prompt the user has answered */
+	atomic_val_t prompt;
+};
+
+K_MSGQ_DEFINE(fsm_msgq, sizeof(struct fsm_event), CONFIG_BT_NUS_EVENT_QUEUE_SIZE, 4);
+
+static int fsm_post_event(struct fsm_event *evt)
+{
+	int err;
+
+	err = k_msgq_put(&fsm_msgq, evt, K_NO_WAIT);
+	if (err) {
+		LOG_WRN("Event queue full, event %d dropped", evt->type);
+		if (evt->conn) {
+			bt_conn_unref(evt->conn);
+		}
+	}
+
+	return err;
+}
+
+/* Post an event to the main thread. Takes a reference to conn if given */
+static int fsm_post(enum fsm_event_type type, struct bt_conn *conn)
+{
+	struct fsm_event evt = {
+		.type = type,
+		.conn = conn ? bt_conn_ref(conn) : NULL,
+	};
+
+	return fsm_post_event(&evt);
+}
+
+/* Post the user's answer (EVT_CONFIRM or EVT_REJECT) to the prompt shown last */
+static int fsm_post_answer(enum fsm_event_type type)
+{
+	struct fsm_event evt = {
+		.type = type,
+		.prompt = atomic_get(&prompt_seq),
+	};
+
+	return fsm_post_event(&evt);
+}
+
+/* Chunk of data received over BLE, queued from the Bluetooth RX context to the BLE RX thread */
+struct ble_rx_chunk_t {
+	struct bt_conn *conn;
+	/* Cycle counter when the chunk was received */
+	uint32_t rx_cycles;
+	uint16_t len;
+	uint8_t data[CONFIG_BT_NUS_RX_CHUNK_SIZE];
+};
+
+K_MSGQ_DEFINE(ble_rx_msgq, sizeof(struct ble_rx_chunk_t), CONFIG_BT_NUS_RX_QUEUE_SIZE, 4);
+
+/* Time spent in the NUS receive callback and in the processing it used to do inline */
+struct ble_rx_stats_t {
+	uint32_t cb_count;
+	uint64_t cb_cycles_total;
+	uint32_t cb_cycles_max;
+	uint32_t proc_count;
+	uint64_t proc_cycles_total;
+	uint32_t proc_cycles_max;
+	uint32_t dropped;
+};
+static struct ble_rx_stats_t rx_stats;
+
+/* UART buffers come from fixed-size pools: O(1) allocation and free, usable from the
+ * UART callback and without fragmenting the heap used by cJSON
+ */
+K_MEM_SLAB_DEFINE(uart_rx_slab, sizeof(struct uart_data_t), CONFIG_BT_NUS_UART_RX_BUF_COUNT, 4);
+
+struct uart_buf_pool {
+	struct k_mem_slab *slab;
+	const char *name;
+	/* Highest number of buffers in use at the same time */
+	atomic_t max_used;
+	atomic_t failures;
+};
+
+static struct uart_buf_pool uart_rx_pool = {
+	.slab = &uart_rx_slab,
+	.name = "UART RX",
+};
+
+static struct uart_data_t *uart_buf_alloc(struct uart_buf_pool *pool)
+{
+	struct uart_data_t *buf;
+	atomic_val_t used;
+	atomic_val_t max_used;
+
+	if (k_mem_slab_alloc(pool->slab, (void **)&buf, K_NO_WAIT)) {
+		atomic_inc(&pool->failures);
+		return NULL;
+	}
+
+	used = k_mem_slab_num_used_get(pool->slab);
+	do {
+		max_used = atomic_get(&pool->max_used);
+	} while ((used > max_used) && !atomic_cas(&pool->max_used, max_used, used));
+
+	buf->len = 0;
+
+	return buf;
+}
+
+static void uart_buf_free(struct uart_buf_pool *pool, struct uart_data_t *buf)
+{
+	k_mem_slab_free(pool->slab, (void **)&buf);
+}
+
+static void uart_buf_pool_log(struct uart_buf_pool *pool)
+{
+	LOG_INF("%s buffers: %u/%u in use, max %u, %u allocation failures", pool->name,
+		k_mem_slab_num_used_get(pool->slab), pool->slab->num_blocks,
+		(uint32_t)atomic_get(&pool->max_used), (uint32_t)atomic_get(&pool->failures));
+}
+
+/* Console output is queued in a ring buffer and sent in bursts: whatever is queued
+ * while a transmission is in progress goes out in the next one, started on UART_TX_DONE
+ */
+#define UART_TX_RING_SIZE CONFIG_BT_NUS_UART_TX_RING_SIZE
+#define UART_TX_RING_MASK (UART_TX_RING_SIZE - 1)
+
+BUILD_ASSERT((UART_TX_RING_SIZE & UART_TX_RING_MASK) == 0,
+	     "UART TX ring buffer size must be a power of two");
+
+static struct {
+	uint8_t buf[UART_TX_RING_SIZE];
+	/* Free running write and read positions */
+	uint32_t head;
+	uint32_t tail;
+	/* Bytes handed to the UART driver, 0 if no transmission is in progress */
+	uint32_t in_flight;
+	uint32_t bursts;
+	uint32_t dropped;
+	struct k_spinlock lock;
+} uart_tx_ring;
+
+/* Claim the next contiguous block to send, if no transmission is in progress.
+ * Called with the lock held
+ */
+static uint32_t uart_tx_claim(void)
+{
+	uint32_t used = uart_tx_ring.head - uart_tx_ring.tail;
+	uint32_t offset = uart_tx_ring.tail & UART_TX_RING_MASK;
+
+	if (uart_tx_ring.in_flight || !used) {
+		return 0;
+	}
+
+	uart_tx_ring.in_flight = MIN(used, UART_TX_RING_SIZE - offset);
+	uart_tx_ring.bursts++;
+
+	return uart_tx_ring.in_flight;
+}
+
+static void uart_tx_start(uint32_t len)
+{
+	uint8_t *data = &uart_tx_ring.buf[uart_tx_ring.tail & UART_TX_RING_MASK];
+
+	if (!len) {
+		return;
+	}
+
+	if (uart_tx(uart, data, len, SYS_FOREVER_MS)) {
+		LOG_WRN("Failed to send data over UART (%d)", 99);
+
+		k_spinlock_key_t key = k_spin_lock(&uart_tx_ring.lock);
+
+		uart_tx_ring.in_flight = 0;
+		k_spin_unlock(&uart_tx_ring.lock, key);
+	}
+}
+
+/* The transmission of len bytes has finished. Send what has been queued meanwhile */
+static void uart_tx_done(size_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&uart_tx_ring.lock);
+	uint32_t next;
+
+	uart_tx_ring.tail += len;
+	uart_tx_ring.in_flight = 0;
+	next = uart_tx_claim();
+
+	k_spin_unlock(&uart_tx_ring.lock, key);
+
+	uart_tx_start(next);
+}
+
+/* Queue console output. Output that does not fit in the ring buffer is dropped */
+static void console_write(const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+	k_spinlock_key_t key;
+	uint32_t space;
+	size_t cnt;
+	uint32_t next;
+
+	if (!uart) {
+		/* No UART console */
+		return;
+	}
+
+	key = k_spin_lock(&uart_tx_ring.lock);
+	space = UART_TX_RING_SIZE - (uart_tx_ring.head - uart_tx_ring.tail);
+	cnt = MIN(len, space);
 
-enum CURRENT_STATE {IDLE, WAITING_GET_PWD_CONF, WAITING_STORE_PWD_CONF, WAITING_DELETE_ALL, DELETE_ALL_CONFIRMED, WAITING_SHOW_LIST, WAITING_REQUEST_ERROR};
-int state = IDLE;
+	for (size_t i = 0; i < cnt; i++) {
+		uart_tx_ring.buf[uart_tx_ring.head++ & UART_TX_RING_MASK] = bytes[i];
+	}
+	uart_tx_ring.dropped += len - cnt;
+	next = uart_tx_claim();
+
+	k_spin_unlock(&uart_tx_ring.lock, key);
+
+	uart_tx_start(next);
+}
 
-char msg_rcv_buff[256];
+/* Echo data received over BLE. It may contain confidential information, so only
+ * its length is shown
+ */
+static void console_echo_masked(size_t len)
+{
+	static const uint8_t spaces[UART_BUF_SIZE] = {[0 ... UART_BUF_SIZE - 1] = ' '};
+
+	console_write(spaces, MIN(len, sizeof(spaces)));
+	console_write("\r\n", 2);
+}
 
 static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
 {
 	ARG_UNUSED(dev);
 
 	static uint8_t *current_buf;
-	static size_t aborted_len;
 	static bool buf_release;
 	struct uart_data_t *buf;
-	static uint8_t *aborted_buf;
 
 	switch (evt->type) {
 	case UART_TX_DONE:
@@ -122,26 +388,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 			return;
 		}
 
-		if (aborted_buf) {
-			buf = CONTAINER_OF(aborted_buf, struct uart_data_t,
-					   data);
-			aborted_buf = NULL;
-			aborted_len = 0;
-		} else {
-			buf = CONTAINER_OF(evt->data.tx.buf, struct uart_data_t,
-					   data);
-		}
-
-		k_free(buf);
-
-		buf = k_fifo_get(&fifo_uart_tx_data, K_NO_WAIT);
-		if (!buf) {
-			return;
-		}
-
-		if (uart_tx(uart, buf->data, buf->len, SYS_FOREVER_MS)) {
-			LOG_WRN("Failed to send data over UART (%d)", 99);
-		}
+		uart_tx_done(evt->data.tx.len);
 
 		break;
 
@@ -165,10 +412,8 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 	case UART_RX_DISABLED:
 		LOG_DBG("rx_disabled");
-		buf = k_malloc(sizeof(*buf));
-		if (buf) {
-			buf->len = 0;
-		} else {
+		buf = uart_buf_alloc(&uart_rx_pool);
+		if (!buf) {
 			LOG_WRN("Not able to allocate UART receive buffer (%d)", 99);
 			k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
 			return;
@@ -181,9 +426,8 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 	case UART_RX_BUF_REQUEST:
 		LOG_DBG("rx_buf_request");
-		buf = k_malloc(sizeof(*buf));
+		buf = uart_buf_alloc(&uart_rx_pool);
 		if (buf) {
-			buf->len = 0;
 			uart_rx_buf_rsp(uart, buf->data, sizeof(buf->data));
 		} else {
 			LOG_WRN("Not able to allocate UART receive buffer (%d)", 99);
@@ -196,7 +440,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		buf = CONTAINER_OF(evt->data.rx_buf.buf, struct uart_data_t,
 				   data);
 		if (buf_release && (current_buf != evt->data.rx_buf.buf)) {
-			k_free(buf);
+			uart_buf_free(&uart_rx_pool, buf);
 			buf_release = false;
 			current_buf = NULL;
 		}
@@ -204,17 +448,9 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		break;
 
 	case UART_TX_ABORTED:
-			LOG_DBG("tx_aborted");
-			if (!aborted_buf) {
-				aborted_buf = (uint8_t *)evt->data.tx.buf;
-			}
-
-			aborted_len += evt->data.tx.len;
-			buf = CONTAINER_OF(aborted_buf, struct uart_data_t,
-					   data);
-
-			uart_tx(uart, &buf->data[aborted_len],
-				buf->len - aborted_len, SYS_FOREVER_MS);
+		LOG_DBG("tx_aborted");
+		/* Send the rest again */
+		uart_tx_done(evt->data.tx.len);
 
 		break;
 
@@ -227,10 +463,8 @@ static void uart_work_handler(struct k_work *item)
 {
 	struct uart_data_t *buf;
 
-	buf = k_malloc(sizeof(*buf));
-	if (buf) {
-		buf->len = 0;
-	} else {
+	buf = uart_buf_alloc(&uart_rx_pool);
+	if (!buf) {
 		LOG_WRN("Not able to allocate UART receive buffer (%d)", 99);
 		k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
 		return;
@@ -250,9 +484,7 @@ static bool uart_test_async_api(const struct device *dev)
 static int uart_init(void)
 {
 	int err;
-	int pos;
 	struct uart_data_t *rx;
-	struct uart_data_t *tx;
 
 	uart = device_get_binding(CONFIG_BT_NUS_UART_DEV);
 	if (!uart) {
@@ -267,10 +499,8 @@ static int uart_init(void)
 		}
 	}
 
-	rx = k_malloc(sizeof(*rx));
-	if (rx) {
-		rx->len = 0;
-	} else {
+	rx = uart_buf_alloc(&uart_rx_pool);
+	if (!rx) {
 		return -ENOMEM;
 	}
 
@@ -312,30 +542,24 @@ static int uart_init(void)
 		}
 	}
 
-	tx = k_malloc(sizeof(*tx));
-
-	if (tx) {
-		pos = snprintf(tx->data, sizeof(tx->data),
-			       "Starting BH Password Manager\r\n");
-
-		if ((pos < 0) || (pos >= sizeof(tx->data))) {
-			k_free(tx);
-			LOG_ERR("snprintf returned %d", pos);
-			return -ENOMEM;
-		}
+	console_write(WELCOME_MSG, sizeof(WELCOME_MSG) - 1);
 
-		tx->len = pos;
-	} else {
-		return -ENOMEM;
-	}
+	return uart_rx_enable(uart, rx->data, sizeof(rx->data), 50);
+}
 
-	err = uart_tx(uart, tx->data, tx->len, SYS_FOREVER_MS);
-	if (err) {
-		LOG_ERR("Cannot display welcome message (err: %d)", err);
-		return err;
+static void ble_rx_stats_log(void)
+{
+	if (!rx_stats.cb_count || !rx_stats.proc_count) {
+		return;
 	}
 
-	return uart_rx_enable(uart, rx->data, sizeof(rx->data), 50);
+	LOG_INF("BT RX callback: %u chunks, avg %u us, max %u us, dropped %u",
+		rx_stats.cb_count,
+		(uint32_t)k_cyc_to_us_floor64(rx_stats.cb_cycles_total / rx_stats.cb_count),
+		k_cyc_to_us_floor32(rx_stats.cb_cycles_max), rx_stats.dropped);
+	LOG_INF("BLE RX thread processing (previously done in the callback): avg %u us, max %u us",
+		(uint32_t)k_cyc_to_us_floor64(rx_stats.proc_cycles_total / rx_stats.proc_count),
+		k_cyc_to_us_floor32(rx_stats.proc_cycles_max));
 }
 
 static void connected(struct bt_conn *conn, uint8_t err)
@@ -350,7 +574,12 @@ static void connected(struct bt_conn *conn, uint8_t err)
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 	LOG_INF("Connected %s", log_strdup(addr));
 
-	current_conn = bt_conn_ref(conn);
+	response_sender_conn_init(conn);
+
+	if (!session_open(conn)) {
+		LOG_ERR("No free session for %s", log_strdup(addr));
+		return;
+	}
 
 	dk_set_led_on(CON_STATUS_LED);
 }
@@ -358,20 +587,33 @@ static void connected(struct bt_conn *conn, uint8_t err)
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
+	struct console_out_stats out_stats;
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
 	LOG_INF("Disconnected: %s (reason %u)", log_strdup(addr), reason);
 
-	if (auth_conn) {
+	ble_rx_stats_log();
+	uart_buf_pool_log(&uart_rx_pool);
+	LOG_INF("UART TX: %u bursts, %u bytes dropped", uart_tx_ring.bursts, uart_tx_ring.dropped);
+	console_out_stats_get(&out_stats);
+	LOG_INF("Console output: %u messages, %u dropped, max %u bytes queued",
+		out_stats.messages, out_stats.dropped, out_stats.max_used);
+	response_sender_reset(conn);
+	response_sender_stats_log();
+	if (IS_ENABLED(CONFIG_BT_NUS_APPROVAL_SESSION)) {
+		LOG_INF("Requests served without confirmation: %u",
+			session_approval_served_total());
+	}
+
+	if (auth_conn == conn) {
 		bt_conn_unref(auth_conn);
 		auth_conn = NULL;
 	}
 
-	if (current_conn) {
-		bt_conn_unref(current_conn);
-		current_conn = NULL;
-		dk_set_led_off(CON_STATUS_LED);
+	/* The session is closed by the main thread, which may be serving its request */
+	if (session_get(conn) && fsm_post(EVT_DISCONNECTED, conn)) {
+		session_close(conn);
 	}
 }
 
@@ -384,6 +626,12 @@ static void security_changed(struct bt_conn *conn, bt_security_t level,
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
 	if (!err) {
+		struct session *s = session_get(conn);
+
+		if (s) {
+			s->sec_level = level;
+		}
+
 		LOG_INF("Security changed: %s level %u", log_strdup(addr),
 			level);
 	} else {
@@ -467,142 +715,156 @@ static struct bt_conn_auth_cb conn_auth_callbacks = {
 static struct bt_conn_auth_cb conn_auth_callbacks;
 #endif
 
-static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
-			  uint16_t len)
+/* Reassemble and parse a chunk received over BLE. Runs in the BLE RX thread */
+static void ble_rx_process(struct bt_conn *conn, const uint8_t *const data,
+			   uint16_t len, uint32_t rx_cycles)
 {
 	int err;
-	char addr[BT_ADDR_LE_STR_LEN] = {0};
+	struct session *s = session_get(conn);
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, ARRAY_SIZE(addr));
+	if (!s) {
+		/* The client has already disconnected */
+		return;
+	}
 
-	LOG_INF("Received data from: %s", log_strdup(addr));
+	LOG_INF("Received data from: %s", log_strdup(s->addr));
 
 	for (uint16_t pos = 0; pos != len;) {
-		struct uart_data_t *tx = k_malloc(sizeof(*tx));
+		/* Keep the last byte of the slice for potential LF char. */
+		uint16_t msg_len = MIN(len - pos, UART_BUF_SIZE - 1);
+		char ble_msg[UART_BUF_SIZE + 1];
 
-		if (!tx) {
-			LOG_WRN("Not able to allocate UART send data buffer (%d)", 99);
-			return;
+		memcpy(ble_msg, &data[pos], msg_len);
+
+		pos += msg_len;
+
+		/* Append the LF character when the CR character triggered
+		 * transmission from the peer.
+		 */
+		if ((pos == len) && (data[len - 1] == '\r')) {
+			ble_msg[msg_len] = '\n';
+			msg_len++;
+		}
+		ble_msg[msg_len] = '\0';
+
+		if (IS_ENABLED(CONFIG_BT_NUS_CONSOLE_ECHO)) {
+			console_echo_masked(msg_len);
 		}
 
-		/* Keep the last byte of TX buffer for potential LF char. */
-		size_t tx_data_size = sizeof(tx->data) - 1;
+		/* A JSON message can arrive in different packets */
+		bool first = msg_assembler_idle(&s->msg_rcv);
 
-		if ((len - pos) > tx_data_size) {
-			tx->len = tx_data_size;
-		} else {
-			tx->len = (len - pos);
+		err = msg_assembler_put(&s->msg_rcv, ble_msg, msg_len);
+		if (err == -ENOMSG) {
+			/* Not the first packet of a message. Discard it */
+			continue;
+		}
+
+		if (first) {
+			/* First packet of a message. Its trace starts once it is accepted */
+			s->msg_start = rx_cycles;
+			conn_params_request_start(conn);
+			advertising_request_received(conn);
 		}
 
-		memcpy(tx->data, &data[pos], tx->len);
+		if (err == -EMSGSIZE) {
+			console_out_printf("Message error. Message exceeds the maximum allowed length\n");
 
-		pos += tx->len;
+			if (response_send(conn, ERR_WRONG_FORMAT, strlen(ERR_WRONG_FORMAT))) {
+				LOG_WRN("Failed to send data over BLE connection (%d)", 99);
+			}
+			continue;
+		}
 
-		/* Append the LF character when the CR character triggered
-		 * transmission from the peer.
-		 */
-		if ((pos == len) && (data[len - 1] == '\r')) {
-			tx->data[tx->len] = '\n';
-			tx->len++;
+		if (err == 0) {
+			/* Wait for the following packets */
+			continue;
 		}
 
-		/* Save the message received */
-		char ble_msg[tx->len+1]; 
-		if(tx->len < UART_BUF_SIZE) tx->data[tx->len] = '\0';
-		strcpy(ble_msg, tx->data);
+		/* Last message. Only one request per client is served at a time */
+		if (s->busy) {
+			msg_assembler_reset(&s->msg_rcv);
+			console_out_printf("Request from %s discarded. A previous request is still pending\n", s->addr);
 
-		/* The message received may contain confidential information. It is better to delete it */
-		for(int i = 0; i < tx->len; i++){
-			tx->data[i] = ' ';
+			if (response_send(conn, ERR_BUSY, strlen(ERR_BUSY))) {
+				LOG_WRN("Failed to send data over BLE connection (%d)", 99);
+			}
+			continue;
 		}
 
-		err = uart_tx(uart, tx->data, tx->len, SYS_FOREVER_MS);
+		latency_trace_start(&s->trace, s->msg_start);
+		latency_trace_mark(&s->trace, LATENCY_REASSEMBLY);
+		err = request_parse(s->msg_rcv.buf, &s->request);
+		msg_assembler_reset(&s->msg_rcv);
+		latency_trace_mark(&s->trace, LATENCY_PARSE);
 		if (err) {
-			k_fifo_put(&fifo_uart_tx_data, tx);
+			memset(&s->request, 0, sizeof(s->request));
+			if (response_send(conn, ERR_WRONG_FORMAT, strlen(ERR_WRONG_FORMAT))) {
+				LOG_WRN("Failed to send data over BLE connection (%d)", 99);
+			}
+			continue;
 		}
 
-		printk("\n");
+		/* Let the main thread serve it */
+		session_submit(s);
+		fsm_post(EVT_REQUEST, NULL);
+	}
+}
 
-		/* A JSON message can arrive in different packets */
-		if (ble_msg[tx->len - 1] == '}'){
-			/* Last message */
-			if(ble_msg[0] == '{'){
-				/* It's a single message */
-				strcpy(msg_rcv_buff, ble_msg);
-			}else{
-				strcat(msg_rcv_buff, ble_msg);
-			}			
-
-			/* Parse JSON
-			Messages must be composed of 2 or 3 string values (depending on the type of message). Keys must be "username", "url" and (optionally) "pwd"
-			Example: {"url": "myurl.something", "username": "myusername"} or {"username": "myusername", "url": "myurl.something", "pwd": "mypassword"}*/
-			const cJSON *monitor_json = cJSON_Parse(msg_rcv_buff);
-			if(monitor_json == NULL){
-				printk("Error parsing JSON message\n");
-			}else{
-				const cJSON *json_url = cJSON_GetObjectItemCaseSensitive(monitor_json, "url");
-				const cJSON *json_username = cJSON_GetObjectItemCaseSensitive(monitor_json, "user");
-				const cJSON *json_pwd = cJSON_GetObjectItemCaseSensitive(monitor_json, "pwd");
-
-				if( cJSON_IsString(json_url) && (json_url->valuestring != NULL) && cJSON_IsString(json_username) && (json_username->valuestring != NULL) ){
-					/* It's a correct message */
-					if(cJSON_IsString(json_pwd) && (json_pwd->valuestring != NULL)){
-						/* It's a password register request */
-						if( (strlen(json_url->valuestring) <= URL_SIZE) && (strlen(json_username->valuestring) <= USERNAME_SIZE) && (strlen(json_pwd->valuestring) <= PWD_SIZE) ){
-							strcpy(pwdStruct.pwd, json_pwd->valuestring);
-							strcpy(pwdStruct.url, json_url->valuestring);
-							strcpy(pwdStruct.username, json_username->valuestring);
-
-							k_mutex_lock(&state_mutex, K_FOREVER);
-							state = WAITING_STORE_PWD_CONF;
-							k_mutex_unlock(&state_mutex);
-
-							printk("Do you want to store the password for user \"%s\"?\nTo confirm/reject, type Y/n\n", pwdStruct.username);
-						}else{
-							k_mutex_lock(&state_mutex, K_FOREVER);
-							state = WAITING_REQUEST_ERROR;
-							k_mutex_unlock(&state_mutex);
-
-							printk("Message error. Make sure the fields do not exceed the maximum allowed length");
-
-							k_sem_give(&sem);
-						}
-						
-					}else{
-						/* It's a password get request */
-						if( (strlen(json_url->valuestring) <= URL_SIZE) && (strlen(json_username->valuestring) <= USERNAME_SIZE) ){
-							strcpy(pwdStruct.url, json_url->valuestring);				
-							strcpy(pwdStruct.username, json_username->valuestring);
-							strcpy(pwdStruct.pwd, "");
-							k_sem_give(&sem);
-						}else{
-							k_mutex_lock(&state_mutex, K_FOREVER);
-							state = WAITING_REQUEST_ERROR;
-							k_mutex_unlock(&state_mutex);
-
-							printk("Message error. Make sure the fields do not exceed the maximum allowed length");
-
-							k_sem_give(&sem);
-						}
-						
-					}
-				}else{
-					printk("Wrong message format\n");
-				}
-			}
-		} else if(ble_msg[0] == '{'){
-			/* First message */
-			strcpy(msg_rcv_buff, ble_msg);
-			
-		} else {
-			/* Other message*/
-			strcat(msg_rcv_buff, ble_msg);
+/* Runs in the Bluetooth host RX context: only copy the data and hand it over to the BLE RX thread */
+static void ble_rx_enqueue(struct bt_conn *conn, const uint8_t *const data,
+			   uint16_t len)
+{
+	uint32_t start = k_cycle_get_32();
+	struct ble_rx_chunk_t chunk;
+
+	for (uint16_t pos = 0; pos != len;) {
+		chunk.len = MIN(len - pos, sizeof(chunk.data));
+		memcpy(chunk.data, &data[pos], chunk.len);
+		pos += chunk.len;
+		chunk.rx_cycles = start;
+
+		chunk.conn = bt_conn_ref(conn);
+		if (k_msgq_put(&ble_rx_msgq, &chunk, K_NO_WAIT)) {
+			bt_conn_unref(chunk.conn);
+			rx_stats.dropped++;
 		}
 	}
+
+	uint32_t cycles = k_cycle_get_32() - start;
+
+	rx_stats.cb_count++;
+	rx_stats.cb_cycles_total += cycles;
+	rx_stats.cb_cycles_max = MAX(rx_stats.cb_cycles_max, cycles);
+}
+
+static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
+			  uint16_t len)
+{
+	response_sender_set_transport(conn, RESPONSE_TRANSPORT_NUS);
+	ble_rx_enqueue(conn, data, len);
+}
+
+static void cred_receive_cb(struct bt_conn *conn, const uint8_t *const data,
+			    uint16_t len)
+{
+	response_sender_set_transport(conn, RESPONSE_TRANSPORT_CREDENTIAL_SERVICE);
+	ble_rx_enqueue(conn, data, len);
+}
+
+static void bt_sent_cb(struct bt_conn *conn)
+{
+	response_sender_on_sent(conn);
 }
 
 static struct bt_nus_cb nus_cb = {
 	.received = bt_receive_cb,
+	.sent = bt_sent_cb,
+};
+
+static const struct credential_service_cb cred_cb = {
+	.received = cred_receive_cb,
+	.sent = bt_sent_cb,
 };
 
 void error(void)
@@ -630,10 +892,37 @@ static void num_comp_reply(bool accept)
 	auth_conn = NULL;
 }
 
+#endif /* CONFIG_BT_NUS_SECURITY_ENABLED */
+
+/* Blink the run status LED while a request is waiting for confirmation */
+static void pending_led_blink(struct k_work *work)
+{
+	static bool blink_status;
+
+	if (!atomic_get(&confirmation_pending)) {
+		blink_status = false;
+		dk_set_led_off(RUN_STATUS_LED);
+		return;
+	}
+
+	blink_status = !blink_status;
+	dk_set_led(RUN_STATUS_LED, blink_status);
+	k_work_reschedule(k_work_delayable_from_work(work), K_MSEC(RUN_LED_PENDING_BLINK_INTERVAL));
+}
+
+static K_WORK_DELAYABLE_DEFINE(pending_led_work, pending_led_blink);
+
+static void pending_led_start(void)
+{
+	k_work_reschedule(&pending_led_work, K_NO_WAIT);
+}
+
 void button_changed(uint32_t button_state, uint32_t has_changed)
 {
 	uint32_t buttons = button_state & has_changed;
 
+#ifdef CONFIG_BT_NUS_SECURITY_ENABLED
+	/* Pairing confirmation takes precedence over requests */
 	if (auth_conn) {
 		if (buttons & KEY_PASSKEY_ACCEPT) {
 			num_comp_reply(true);
@@ -642,20 +931,30 @@ void button_changed(uint32_t button_state, uint32_t has_changed)
 		if (buttons & KEY_PASSKEY_REJECT) {
 			num_comp_reply(false);
 		}
+
+		return;
+	}
+
+	if (buttons & KEY_APPROVAL_END) {
+		session_approval_end_all();
 	}
-}
 #endif /* CONFIG_BT_NUS_SECURITY_ENABLED */
 
+	if (buttons & KEY_REQUEST_ACCEPT) {
+		fsm_post_answer(EVT_CONFIRM);
+	} else if (buttons & KEY_REQUEST_REJECT) {
+		fsm_post_answer(EVT_REJECT);
+	}
+}
+
 static void configure_gpio(void)
 {
 	int err;
 
-#ifdef CONFIG_BT_NUS_SECURITY_ENABLED
 	err = dk_buttons_init(button_changed);
 	if (err) {
 		LOG_ERR("Cannot init buttons (err: %d)", err);
 	}
-#endif /* CONFIG_BT_NUS_SECURITY_ENABLED */
 
 	err = dk_leds_init();
 	if (err) {
@@ -663,140 +962,932 @@ static void configure_gpio(void)
 	}
 }
 
-void main(void)
+/* Reply to the client whose request is being served */
+static int send_response(const char *msg)
 {
-	int err = 0;
+	int err;
+	struct bt_conn *conn = active_session ? active_session->conn : NULL;
 
-	configure_gpio();
+	if (active_session) {
+		/* Only the first message of a response is traced */
+		latency_trace_end(&active_session->trace);
+	}
 
-	err = uart_init();
+	err = response_send(conn, msg, strlen(msg));
 	if (err) {
-		error();
+		LOG_WRN("Failed to send data over BLE connection (%d)", err);
 	}
 
-	if (IS_ENABLED(CONFIG_BT_NUS_SECURITY_ENABLED)) {
-		bt_conn_auth_cb_register(&conn_auth_callbacks);
+	return err;
+}
+
+/* Start an approval session after the user has confirmed a get request */
+static void approval_start(struct session *s, const char *url)
+{
+	if (!IS_ENABLED(CONFIG_BT_NUS_APPROVAL_SESSION) || !s->conn) {
+		return;
 	}
 
-	err = bt_enable(NULL);
-	if (err) {
-		error();
+	if (session_approval_start(s, url) == 0) {
+		console_out_printf("Approval session started for %s. Gets are served without confirmation for %d s. Press Button 3 to end it\n",
+				   s->addr, CONFIG_BT_NUS_APPROVAL_SESSION_TIMEOUT);
 	}
+}
 
-	LOG_INF("Bluetooth initialized%s", "");
+/* Send the password of a get request */
+static void send_pwd_response(const struct TPassword *pwdStruct)
+{
+	char pwd_msg[12+PWD_SIZE];
 
-	k_sem_give(&ble_init_ok);
+	strcpy(pwd_msg, "{\"pwd\": \"" );
+	strcpy(pwd_msg + 9, pwdStruct->pwd);
+	strcpy(pwd_msg + 9 + strlen(pwdStruct->pwd), "\"}");
 
-	if (IS_ENABLED(CONFIG_SETTINGS)) {
-		settings_load();
+	if (!send_response(pwd_msg)) {
+		console_out_printf("Password sent to client\n");
 	}
 
-	err = bt_nus_init(&nus_cb);
-	if (err) {
-		LOG_ERR("Failed to initialize UART service (err: %d)", err);
-		return;
-	}
+	/* The password is no longer needed */
+	memset(pwd_msg, 0, sizeof(pwd_msg));
+}
 
-	err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd,
-			      ARRAY_SIZE(sd));
-	if (err) {
-		LOG_ERR("Advertising failed to start (err %d)", err);
-		return;
-	}
+/* Send one message per batch entry, in request order, followed by ERR_OK */
+static void send_batch_response(struct TBatchRequest *batch)
+{
+	char batch_msg[BATCH_MSG_SIZE];
+	int sent = 0;
+
+	for (int i = 0; i < batch->len; i++) {
+		if (batch->found[i]) {
+			snprintf(batch_msg, sizeof(batch_msg), BATCH_PWD_MSG, i,
+				 batch->entries[i].pwd);
+			sent++;
+		} else {
+			snprintf(batch_msg, sizeof(batch_msg), BATCH_NOT_FOUND_MSG, i);
+		}
 
-	err = store_manager_init();
-	if (err < 0){
-		return;
+		send_response(batch_msg);
 	}
 
-	k_sem_init(&sem, 0, 1);
-	k_mutex_init(&state_mutex);
+	/* The password is no longer needed */
+	memset(batch_msg, 0, sizeof(batch_msg));
 
-	for(;;){
-		k_sem_take(&sem, K_FOREVER);
-
-		k_mutex_lock(&state_mutex, K_FOREVER);
-		int current_state = state;
-		k_mutex_unlock(&state_mutex);
-
-		if(current_state == DELETE_ALL_CONFIRMED){
-			deleteAllPwd();
-			printk("All stored passwords have been deleted\n");
-			k_mutex_lock(&state_mutex, K_FOREVER);
-			state = IDLE;
-			k_mutex_unlock(&state_mutex);
-
-		}else if(current_state == WAITING_SHOW_LIST){
-			k_mutex_lock(&state_mutex, K_FOREVER);
-			state = IDLE;
-			k_mutex_unlock(&state_mutex);
-			struct TPassword tmpPwdList[MAX_STORABLE_PWD];
-			err = getAllPwd(tmpPwdList);
-			if(err > 0){
-				printk("List of stored password (%d):\n", err);
-				for(int i = 0; i < err; i++){
-					printk("\t%d. URL: %s, username: %s\n", i, tmpPwdList[i].url, tmpPwdList[i].username);
-				}
-			}else if(err == 0){
-				printk("No password stored\n");
-			}else{
-				printk("err = %d\n", err);
-			}
+	if (!send_response(ERR_OK)) {
+		console_out_printf("%d passwords sent to client\n", sent);
+	}
+}
 
-		}else if(current_state == WAITING_REQUEST_ERROR){
-			if (bt_nus_send(NULL, ERR_WRONG_FORMAT, strlen(ERR_WRONG_FORMAT))) {
-				LOG_WRN("Failed to send data over BLE connection (%d)", 99);
-			}
+/* Send one message per search match, in URL order, followed by the number of matches */
+static void send_search_response(struct TBatchRequest *results)
+{
+	char search_msg[SEARCH_MSG_SIZE];
 
-			k_mutex_lock(&state_mutex, K_FOREVER);
-			state = IDLE;
-			k_mutex_unlock(&state_mutex);
-
-		}else if(strcmp(pwdStruct.pwd, "") == 0){
-			/* Get password */
-			err = getPwd(&pwdStruct);
-			if(err == 0){
-				/* Password obtained */
-				printk("New message:\n");
-				printk("\t- URL: %s\n", pwdStruct.url);
-				printk("\t- Username: %s\n", pwdStruct.username);
-				/*printk("There is a password stored for this user: %s\n", pwdStruct.pwd);*/
-
-				/* Password obtained. Ask user for confirmation */
-				printk("There is a password stored for user '%s'.\nTo confirm/reject, type Y/n\n", pwdStruct.username);
-				k_mutex_lock(&state_mutex, K_FOREVER);
-				state = WAITING_GET_PWD_CONF;
-				k_mutex_unlock(&state_mutex);
-			}else{
-				printk("Password is not stored (err = %d)\n", err);
-
-				if (bt_nus_send(NULL, ERR_OPERATION_REJECTED, strlen(ERR_OPERATION_REJECTED))) {
-					LOG_WRN("Failed to send data over BLE connection (%d)", 99);
-				}
+	for (int i = 0; i < results->len; i++) {
+		snprintf(search_msg, sizeof(search_msg), SEARCH_MATCH_MSG, i,
+			 results->entries[i].url, results->entries[i].username);
+		send_response(search_msg);
+	}
+
+	snprintf(search_msg, sizeof(search_msg), SEARCH_DONE_MSG, results->total);
+	if (!send_response(search_msg)) {
+		console_out_printf("%d search results sent to client\n", results->len);
+	}
+}
+
+static bool search_visit(const struct TPassword *pwd, void *ctx)
+{
+	struct TBatchRequest *results = ctx;
+
+	if (results->len < BATCH_MAX_SIZE) {
+		strcpy(results->entries[results->len].url, pwd->url);
+		strcpy(results->entries[results->len].username, pwd->username);
+		results->len++;
+	}
+	results->total++;
+
+	return true;
+}
+
+/* The request being served is finished. The next one can be served */
+static void request_done(void)
+{
+	if (active_session) {
+		session_done(active_session);
+		active_session = NULL;
+	}
+}
+
+/* Serve a request received from a client. Requests that need confirmation are left
+ * waiting for the user, the rest are answered straight away
+ */
+static enum CURRENT_STATE serve_request(struct session *s)
+{
+	int err;
+	struct TRequest *request = &s->request;
+
+	console_out_printf("New message from %s (security level %d):\n", s->addr, s->sec_level);
+
+	if(request->type == REQUEST_STORE){
+		console_out_printf("\t- URL: %s\n", request->pwd.url);
+		console_out_printf("\t- Username: %s\n", request->pwd.username);
+		/*printk("\t- Password: %s\n", request->pwd.pwd);*/
+		console_out_printf("\t- Password: ********\n");
+		console_out_printf("Do you want to store the password for user \"%s\"?\n" CONFIRM_PROMPT, request->pwd.username);
+		return WAITING_STORE_PWD_CONF;
+
+	}else if(request->type == REQUEST_GET){
+		/* Get password */
+		err = getPwd(&request->pwd);
+		latency_trace_mark(&s->trace, LATENCY_LOOKUP);
+		if(err == 0 && session_approval_check(s)){
+			/* Already approved by the user */
+			console_out_printf("\t- URL: %s\n", request->pwd.url);
+			console_out_printf("\t- Username: %s\n", request->pwd.username);
+			console_out_printf("Approval session active. No confirmation needed\n");
+			send_pwd_response(&request->pwd);
+			request_done();
+		}else if(err == 0){
+			/* Password obtained */
+			console_out_printf("\t- URL: %s\n", request->pwd.url);
+			console_out_printf("\t- Username: %s\n", request->pwd.username);
+			/*printk("There is a password stored for this user: %s\n", request->pwd.pwd);*/
+
+			/* Password obtained. Ask user for confirmation */
+			console_out_printf("There is a password stored for user '%s'.\n" CONFIRM_PROMPT, request->pwd.username);
+			return WAITING_GET_PWD_CONF;
+		}else{
+			console_out_printf("Password is not stored (err = %d)\n", err);
+			send_response(ERR_OPERATION_REJECTED);
+			request_done();
+		}
+
+	}else if(request->type == REQUEST_GET_BATCH){
+		struct TBatchRequest *batch = &request->batch;
+
+		/* Get every password of the batch */
+		int found = 0;
+		for(int i = 0; i < batch->len; i++){
+			batch->found[i] = (getPwd(&batch->entries[i]) == 0);
+			if(batch->found[i]) found++;
+		}
+		latency_trace_mark(&s->trace, LATENCY_LOOKUP);
+
+		if(found > 0 && session_approval_check(s)){
+			/* Already approved by the user */
+			console_out_printf("Batch request (%d/%d passwords stored)\n", found, batch->len);
+			console_out_printf("Approval session active. No confirmation needed\n");
+			send_batch_response(batch);
+			request_done();
+		}else if(found > 0){
+			console_out_printf("Batch request (%d/%d passwords stored):\n", found, batch->len);
+			for(int i = 0; i < batch->len; i++){
+				console_out_printf("\t%d. URL: %s, username: %s%s\n", i, batch->entries[i].url,
+						   batch->entries[i].username, batch->found[i] ? "" : " (not stored)");
 			}
+
+			/* Passwords obtained. Ask user for a single confirmation */
+			console_out_printf("Do you want to send the %d stored passwords?\n" CONFIRM_PROMPT, found);
+			return WAITING_GET_BATCH_CONF;
 		}else{
-			printk("New message:\n");
-			printk("\t- URL: %s\n", pwdStruct.url);
-			printk("\t- Username: %s\n", pwdStruct.username);
-			/*printk("\t- Password: %s\n", pwdStruct.pwd);*/
-			printk("\t- Password: ********\n");
-
-			/* Storage password*/
-			err = storePwd(&pwdStruct);
-			strcpy(pwdStruct.pwd, ""); // Must be empty for future uses
-			if(err == 0){
-				printk("Password stored\n");
-				if (bt_nus_send(NULL, ERR_OK, strlen(ERR_OK))) {
-					LOG_WRN("Failed to send data over BLE connection (%d)", 99);
-				}
-			}else if(err == -1){
-				printk("Storage is full. No new password can be stored\n");
-				if (bt_nus_send(NULL, ERR_COMPLETE_STORAGE, strlen(ERR_COMPLETE_STORAGE))) {
-					LOG_WRN("Failed to send data over BLE connection (%d)", 99);
-				}
-			}			
+			console_out_printf("No password of the batch is stored\n");
+			send_response(ERR_OPERATION_REJECTED);
+			request_done();
+		}
+
+	}else if(request->type == REQUEST_SEARCH){
+		struct TBatchRequest *results = &request->batch;
+
+		/* Usernames and URLs are only disclosed with the user's consent, whatever is found,
+		 * even during an approval session
+		 */
+		results->len = 0;
+		results->total = 0;
+		err = forEachPwd(request->pwd.url, search_visit, results);
+		latency_trace_mark(&s->trace, LATENCY_LOOKUP);
+		if(err < 0){
+			console_out_printf("Search failed (err = %d)\n", err);
+			send_response(ERR_OPERATION_REJECTED);
+			request_done();
+		}else{
+			console_out_printf("Search for URLs starting with \"%s\" (%d matches)\n", request->pwd.url,
+					   results->total);
+			console_out_printf("Do you want to send the URLs and usernames found?\n" CONFIRM_PROMPT);
+			return WAITING_SEARCH_CONF;
+		}
+	}
+
+	return IDLE;
+}
+
+/* Serve the pending requests, one at a time and fairly among the clients, until one
+ * needs confirmation
+ */
+static enum CURRENT_STATE serve_requests(const struct fsm_event *evt)
+{
+	struct session *s;
+
+	while ((s = session_next_pending())) {
+		enum CURRENT_STATE next;
+
+		active_session = s;
+		next = serve_request(s);
+		if (next != IDLE) {
+			return next;
+		}
+	}
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE clear_storage_confirmed(const struct fsm_event *evt)
+{
+	deleteAllPwd();
+	console_out_printf("All stored passwords have been deleted\n");
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE clear_storage_rejected(const struct fsm_event *evt)
+{
+	console_out_printf("Clear storage cancelled\n");
+
+	return IDLE;
+}
+
+/* Password the "delete" console command is waiting to delete */
+static struct TPassword pending_delete;
+
+static enum CURRENT_STATE delete_pwd_confirmed(const struct fsm_event *evt)
+{
+	if(deletePwd(&pending_delete) == 0){
+		console_out_printf("Password for %s, username %s deleted\n", pending_delete.url,
+				   pending_delete.username);
+	}else{
+		console_out_printf("Password for %s, username %s not found\n", pending_delete.url,
+				   pending_delete.username);
+	}
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE delete_pwd_rejected(const struct fsm_event *evt)
+{
+	console_out_printf("Delete cancelled\n");
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE delete_pwd_timed_out(const struct fsm_event *evt)
+{
+	console_out_printf("No confirmation received in %d s\n", CONFIG_BT_NUS_CONFIRM_TIMEOUT);
+
+	return delete_pwd_rejected(evt);
+}
+
+static enum CURRENT_STATE get_pwd_confirmed(const struct fsm_event *evt)
+{
+	latency_trace_mark(&active_session->trace, LATENCY_CONFIRM);
+	send_pwd_response(&active_session->request.pwd);
+	approval_start(active_session, active_session->request.pwd.url);
+	request_done();
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE get_batch_confirmed(const struct fsm_event *evt)
+{
+	latency_trace_mark(&active_session->trace, LATENCY_CONFIRM);
+	send_batch_response(&active_session->request.batch);
+	approval_start(active_session, NULL);
+	request_done();
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE search_confirmed(const struct fsm_event *evt)
+{
+	latency_trace_mark(&active_session->trace, LATENCY_CONFIRM);
+	send_search_response(&active_session->request.batch);
+	request_done();
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE store_pwd_confirmed(const struct fsm_event *evt)
+{
+	int err;
+
+	latency_trace_mark(&active_session->trace, LATENCY_CONFIRM);
+
+	/* Storage password*/
+	err = storePwd(&active_session->request.pwd);
+	if(err == 0){
+		console_out_printf("Password stored\n");
+		send_response(ERR_OK);
+	}else if(err == -1){
+		console_out_printf("Storage is full. No new password can be stored\n");
+		send_response(ERR_COMPLETE_STORAGE);
+	}
+	request_done();
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE request_rejected(const struct fsm_event *evt)
+{
+	latency_trace_mark(&active_session->trace, LATENCY_CONFIRM);
+
+	if (active_session->request.type == REQUEST_STORE) {
+		console_out_printf("Password storage cancelled\n");
+	}
+
+	if (!send_response(ERR_OPERATION_REJECTED)) {
+		console_out_printf("Sent: %s\n", ERR_OPERATION_REJECTED);
+	}
+	request_done();
+
+	return IDLE;
+}
+
+static enum CURRENT_STATE request_timed_out(const struct fsm_event *evt)
+{
+	console_out_printf("No confirmation received in %d s\n", CONFIG_BT_NUS_CONFIRM_TIMEOUT);
+
+	return request_rejected(evt);
+}
+
+static enum CURRENT_STATE clear_storage_timed_out(const struct fsm_event *evt)
+{
+	console_out_printf("No confirmation received in %d s\n", CONFIG_BT_NUS_CONFIRM_TIMEOUT);
+
+	return clear_storage_rejected(evt);
+}
+
+static void fsm_stats_log(void);
+static enum CURRENT_STATE run_command(const struct fsm_event *evt);
+
+static enum CURRENT_STATE client_disconnected(const struct fsm_event *evt)
+{
+	enum CURRENT_STATE next = state;
+	struct session *s = session_get(evt->conn);
+
+	if (s && s == active_session) {
+		/* Nobody is left to answer to */
+		console_out_printf("Client %s disconnected. Pending request cancelled\n", s->addr);
+		active_session = NULL;
+		next = IDLE;
+	}
+	session_close(evt->conn);
+
+	if (!session_count()) {
+		dk_set_led_off(CON_STATUS_LED);
+	}
+
+	fsm_stats_log();
+
+	return next;
+}
+
+typedef enum CURRENT_STATE (*fsm_handler_t)(const struct fsm_event *evt);
+
+/* Handler of every event in every state. Events without handler are ignored */
+static const fsm_handler_t fsm_transitions[STATE_COUNT][EVT_COUNT] = {
+	[IDLE] = {
+		[EVT_REQUEST] = serve_requests,
+		[EVT_COMMAND] = run_command,
+		[EVT_DISCONNECTED] = client_disconnected,
+	},
+	[WAITING_GET_PWD_CONF] = {
+		[EVT_CONFIRM] = get_pwd_confirmed,
+		[EVT_REJECT] = request_rejected,
+		[EVT_TIMEOUT] = request_timed_out,
+		[EVT_COMMAND] = run_command,
+		[EVT_DISCONNECTED] = client_disconnected,
+	},
+	[WAITING_STORE_PWD_CONF] = {
+		[EVT_CONFIRM] = store_pwd_confirmed,
+		[EVT_REJECT] = request_rejected,
+		[EVT_TIMEOUT] = request_timed_out,
+		[EVT_COMMAND] = run_command,
+		[EVT_DISCONNECTED] = client_disconnected,
+	},
+	[WAITING_DELETE_ALL] = {
+		[EVT_CONFIRM] = clear_storage_confirmed,
+		[EVT_REJECT] = clear_storage_rejected,
+		[EVT_TIMEOUT] = clear_storage_timed_out,
+		[EVT_COMMAND] = run_command,
+		[EVT_DISCONNECTED] = client_disconnected,
+	},
+	[WAITING_GET_BATCH_CONF] = {
+		[EVT_CONFIRM] = get_batch_confirmed,
+		[EVT_REJECT] = request_rejected,
+		[EVT_TIMEOUT] = request_timed_out,
+		[EVT_COMMAND] = run_command,
+		[EVT_DISCONNECTED] = client_disconnected,
+	},
+	[WAITING_DELETE_PWD] = {
+		[EVT_CONFIRM] = delete_pwd_confirmed,
+		[EVT_REJECT] = delete_pwd_rejected,
+		[EVT_TIMEOUT] = delete_pwd_timed_out,
+		[EVT_COMMAND] = run_command,
+		[EVT_DISCONNECTED] = client_disconnected,
+	},
+	[WAITING_SEARCH_CONF] = {
+		[EVT_CONFIRM] = search_confirmed,
+		[EVT_REJECT] = request_rejected,
+		[EVT_TIMEOUT] = request_timed_out,
+		[EVT_COMMAND] = run_command,
+		[EVT_DISCONNECTED] = client_disconnected,
+	},
+};
+
+#define CONFIRM_TIMEOUT_MS (CONFIG_BT_NUS_CONFIRM_TIMEOUT * MSEC_PER_SEC)
+
+static const struct {
+	const char *name;
+	/* The state waits for the user to confirm or reject */
+	bool confirmation;
+	/* Time after which EVT_TIMEOUT is posted, 0 for none */
+	uint32_t timeout_ms;
+} fsm_states[STATE_COUNT] = {
+	[IDLE] = {"IDLE", false, 0},
+	[WAITING_GET_PWD_CONF] = {"WAITING_GET_PWD_CONF", true, CONFIRM_TIMEOUT_MS},
+	[WAITING_STORE_PWD_CONF] = {"WAITING_STORE_PWD_CONF", true, CONFIRM_TIMEOUT_MS},
+	[WAITING_DELETE_ALL] = {"WAITING_DELETE_ALL", true, CONFIRM_TIMEOUT_MS},
+	[WAITING_GET_BATCH_CONF] = {"WAITING_GET_BATCH_CONF", true, CONFIRM_TIMEOUT_MS},
+	[WAITING_DELETE_PWD] = {"WAITING_DELETE_PWD", true, CONFIRM_TIMEOUT_MS},
+	[WAITING_SEARCH_CONF] = {"WAITING_SEARCH_CONF", true, CONFIRM_TIMEOUT_MS},
+};
+
+/* Time spent in every state */
+struct fsm_state_stats {
+	uint32_t entries;
+	uint32_t timeouts;
+	int64_t time_ms;
+	int64_t max_ms;
+};
+
+static struct fsm_state_stats fsm_stats[STATE_COUNT];
+static int64_t state_entered;
+static int64_t state_deadline;
+/* Connection of the client request waiting for confirmation, NULL for a console command */
+static struct bt_conn *confirm_conn;
+
+static void fsm_timeout(struct k_work *work)
+{
+	fsm_post(EVT_TIMEOUT, NULL);
+}
+
+static K_WORK_DELAYABLE_DEFINE(fsm_timeout_work, fsm_timeout);
+
+/* Time spent in a state, including the current stay */
+static uint32_t fsm_state_time_ms(enum CURRENT_STATE s)
+{
+	int64_t time_ms = fsm_stats[s].time_ms;
+
+	if (s == state) {
+		time_ms += k_uptime_get() - state_entered;
+	}
+
+	return (uint32_t)time_ms;
+}
+
+static void fsm_stats_log(void)
+{
+	for (int i = 0; i < STATE_COUNT; i++) {
+		const struct fsm_state_stats *stats = &fsm_stats[i];
+
+		LOG_INF("%s: %u entries, %u ms total, %u ms max, %u timeouts", fsm_states[i].name,
+			stats->entries, fsm_state_time_ms(i), (uint32_t)stats->max_ms, stats->timeouts);
+	}
+}
+
+static void fsm_set_state(enum CURRENT_STATE next)
+{
+	int64_t now = k_uptime_get();
+	struct fsm_state_stats *stats = &fsm_stats[state];
+
+	if (next == state) {
+		return;
+	}
+
+	stats->time_ms += now - state_entered;
+	stats->max_ms = MAX(stats->max_ms, now - state_entered);
+
+	k_work_cancel_delayable(&fsm_timeout_work);
+
+	if (confirm_conn) {
+		conn_params_confirm_end(confirm_conn);
+		confirm_conn = NULL;
+	}
+
+	state = next;
+	state_entered = now;
+	fsm_stats[next].entries++;
+
+	if (fsm_states[next].timeout_ms) {
+		state_deadline = now + fsm_states[next].timeout_ms;
+		k_work_reschedule(&fsm_timeout_work, K_MSEC(fsm_states[next].timeout_ms));
+	} else {
+		state_deadline = 0;
+	}
+
+	atomic_set(&confirmation_pending, fsm_states[next].confirmation);
+	if (fsm_states[next].confirmation) {
+		/* Answers queued for an earlier prompt no longer apply */
+		atomic_inc(&prompt_seq);
+
+		/* The request being served, unlike a console command, has a client waiting */
+		if (active_session && active_session->busy && !active_session->queued) {
+			confirm_conn = active_session->conn;
+			conn_params_confirm_start(confirm_conn);
+		}
+		pending_led_start();
+
+		if (IS_ENABLED(CONFIG_BT_NUS_TEST_AUTO_CONFIRM)) {
+			console_out_printf("Confirmed automatically\n");
+			fsm_post_answer(EVT_CONFIRM);
 		}
 	}
+}
+
+/* Console commands. They are run by the main thread, which owns the storage and the state */
+#define CONSOLE_MAX_ARGS 4
+#define CONSOLE_LIST_PAGE_SIZE CONFIG_BT_NUS_CONSOLE_LIST_PAGE_SIZE
+
+struct console_cmd_desc {
+	const char *name;
+	const char *usage;
+	const char *help;
+	/* Number of arguments accepted after the name */
+	uint8_t min_args;
+	uint8_t max_args;
+	/* The command can only run while no request is waiting for confirmation */
+	bool idle_only;
+	enum CURRENT_STATE (*handler)(int argc, char **argv);
+};
+
+/* Command line handed over by the console thread, which waits on console_cmd_done
+ * before reading the next line
+ */
+static struct {
+	const struct console_cmd_desc *desc;
+	int argc;
+	char *argv[CONSOLE_MAX_ARGS];
+	char line[CONFIG_BT_NUS_CONSOLE_LINE_MAX];
+} console_cmd;
+
+static K_SEM_DEFINE(console_cmd_done, 0, 1);
+
+struct pwd_list_ctx {
+	/* Text the URL or the username must contain, NULL for all */
+	const char *find;
+	/* Index of the first match printed */
+	int first;
+	int matches;
+	int printed;
+};
+
+static bool pwd_list_visit(const struct TPassword *pwd, void *ctx)
+{
+	struct pwd_list_ctx *list = ctx;
+
+	if (list->find && !strstr(pwd->url, list->find) && !strstr(pwd->username, list->find)) {
+		return true;
+	}
+
+	if (list->matches >= list->first && list->printed < CONSOLE_LIST_PAGE_SIZE) {
+		console_out_printf("\t%d. URL: %s, username: %s\n", list->matches, pwd->url,
+				   pwd->username);
+		list->printed++;
+	}
+	list->matches++;
+
+	/* The scan goes on past the page to count the matches */
+	return true;
+}
+
+/* Print a page of the passwords whose URL starts with prefix and, for find, whose URL
+ * or username contains find
+ */
+static void pwd_list_print(const char *prefix, const char *find, int page)
+{
+	struct pwd_list_ctx list = {
+		.find = find,
+		.first = (page - 1) * CONSOLE_LIST_PAGE_SIZE,
+	};
+	int pages;
+	int err;
+
+	err = forEachPwd(prefix, pwd_list_visit, &list);
+	if (err < 0) {
+		console_out_printf("err = %d\n", err);
+		return;
+	}
+
+	if (!list.matches) {
+		console_out_printf("No password found\n");
+		return;
+	}
+
+	pages = ceiling_fraction(list.matches, CONSOLE_LIST_PAGE_SIZE);
+	if (page > pages) {
+		console_out_printf("Page %d out of range, %d matches in %d pages\n", page, list.matches,
+				   pages);
+		return;
+	}
+
+	console_out_printf("Page %d/%d, %d matches\n", page, pages, list.matches);
+}
+
+/* Parse the "[text] [--page N]" arguments of list and find */
+static int pwd_list_args(int argc, char **argv, const char **text, int *page)
+{
+	*text = NULL;
+	*page = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--page") == 0) {
+			char *end;
+
+			if (++i == argc) {
+				return -EINVAL;
+			}
+			*page = strtol(argv[i], &end, 10);
+			if (*end || *page < 1) {
+				return -EINVAL;
+			}
+		} else if (!*text) {
+			*text = argv[i];
+		} else {
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static enum CURRENT_STATE cmd_list(int argc, char **argv)
+{
+	const char *prefix;
+	int page;
+
+	if (pwd_list_args(argc, argv, &prefix, &page)) {
+		console_out_printf("Usage: %s\n", console_cmd.desc->usage);
+		return state;
+	}
+
+	console_out_printf("Stored passwords: %d/%d\n", getNumPwd(), MAX_STORABLE_PWD);
+	pwd_list_print(prefix, NULL, page);
+
+	return state;
+}
+
+static enum CURRENT_STATE cmd_find(int argc, char **argv)
+{
+	const char *text;
+	int page;
+
+	if (pwd_list_args(argc, argv, &text, &page) || !text) {
+		console_out_printf("Usage: %s\n", console_cmd.desc->usage);
+		return state;
+	}
+
+	pwd_list_print(NULL, text, page);
+
+	return state;
+}
+
+static enum CURRENT_STATE cmd_delete(int argc, char **argv)
+{
+	if (strlen(argv[1]) > URL_SIZE || strlen(argv[2]) > USERNAME_SIZE) {
+		console_out_printf("URL or username too long\n");
+		return state;
+	}
+
+	strcpy(pending_delete.url, argv[1]);
+	strcpy(pending_delete.username, argv[2]);
+	if (!pwdExists(pending_delete.url, pending_delete.username)) {
+		console_out_printf("Password for %s, username %s not found\n", pending_delete.url,
+				   pending_delete.username);
+		return state;
+	}
+
+	console_out_printf("Are you sure you want to delete the password for %s, username %s?\n"
+			   CONFIRM_PROMPT, pending_delete.url, pending_delete.username);
+
+	return WAITING_DELETE_PWD;
+}
+
+static enum CURRENT_STATE cmd_clear(int argc, char **argv)
+{
+	if (strcmp(argv[1], "storage") != 0) {
+		console_out_printf("Usage: %s\n", console_cmd.desc->usage);
+		return state;
+	}
+
+	console_out_printf("Are you sure you want to delete ALL passwords?\n" CONFIRM_PROMPT);
+
+	return WAITING_DELETE_ALL;
+}
+
+static enum CURRENT_STATE cmd_stats(int argc, char **argv)
+{
+	struct response_sender_stats sender;
+	struct console_out_stats out;
+	struct TLookupStats lookups;
+
+	response_sender_stats_get(&sender);
+	console_out_stats_get(&out);
+	getLookupStats(&lookups);
+
+	console_out_printf("Stored passwords: %d/%d\n", getNumPwd(), MAX_STORABLE_PWD);
+	console_out_printf("Lookups: %u hits, %u misses without flash read, %u false positives\n",
+			   lookups.hits, lookups.misses, lookups.falsePositives);
+	console_out_printf("Connected clients: %d\n", session_count());
+	if (IS_ENABLED(CONFIG_BT_NUS_APPROVAL_SESSION)) {
+		console_out_printf("Requests served without confirmation: %u\n",
+				   session_approval_served_total());
+	}
+	console_out_printf("State: %s\n", fsm_states[state].name);
+	for (int i = 0; i < STATE_COUNT; i++) {
+		console_out_printf("\t%s: %u entries, %u ms total, %u ms max, %u timeouts\n",
+				   fsm_states[i].name, fsm_stats[i].entries, fsm_state_time_ms(i),
+				   (uint32_t)fsm_stats[i].max_ms, fsm_stats[i].timeouts);
+	}
+	console_out_printf("Responses: %u sent, %u notifications, %u bytes, %u retries, "
+			   "%u failures, %u timeouts\n", sender.responses, sender.fragments,
+			   sender.bytes, sender.retries, sender.failures, sender.timeouts);
+	console_out_printf("BLE RX: %u chunks, %u dropped\n", rx_stats.cb_count, rx_stats.dropped);
+	console_out_printf("Console output: %u messages, %u dropped\n", out.messages, out.dropped);
+	latency_print();
+
+	return state;
+}
+
+static enum CURRENT_STATE cmd_mem(int argc, char **argv)
+{
+	mem_diag_print();
+
+	return state;
+}
+
+static enum CURRENT_STATE cmd_cpu(int argc, char **argv)
+{
+	cpu_stats_print();
+
+	return state;
+}
+
+static enum CURRENT_STATE cmd_help(int argc, char **argv);
+
+static const struct console_cmd_desc console_cmds[] = {
+	{"help", "help", "List the commands", 0, 0, false, cmd_help},
+	{"list", "list [prefix] [--page N]", "List the stored passwords whose URL starts with prefix",
+	 0, 3, false, cmd_list},
+	{"find", "find <text> [--page N]", "List the stored passwords whose URL or username contains text",
+	 1, 3, false, cmd_find},
+	{"delete", "delete <url> <username>", "Delete a stored password", 2, 2, true, cmd_delete},
+	{"clear", "clear storage", "Delete all the stored passwords", 1, 1, true, cmd_clear},
+	{"stats", "stats", "Show the storage, request and connection statistics", 0, 0, false,
+	 cmd_stats},
+#if defined(CONFIG_BT_NUS_MEM_DIAG)
+	{"mem", "mem", "Show the stack high-water marks and the heap usage", 0, 0, false, cmd_mem},
+#endif
+#if defined(CONFIG_BT_NUS_CPU_STATS)
+	{"cpu", "cpu", "Show the CPU usage of every thread and the idle time", 0, 0, false, cmd_cpu},
+#endif
+};
+
+static enum CURRENT_STATE cmd_help(int argc, char **argv)
+{
+	for (int i = 0; i < ARRAY_SIZE(console_cmds); i++) {
+		console_out_printf("%-28s %s\n", console_cmds[i].usage, console_cmds[i].help);
+	}
+	console_out_printf("Any other input confirms (Y/y) or rejects a pending request\n");
+
+	return state;
+}
+
+static enum CURRENT_STATE run_command(const struct fsm_event *evt)
+{
+	const struct console_cmd_desc *desc = console_cmd.desc;
+
+	if (desc->idle_only && state != IDLE) {
+		console_out_printf("A request is waiting for confirmation\n" CONFIRM_PROMPT);
+		return state;
+	}
+
+	return desc->handler(console_cmd.argc, console_cmd.argv);
+}
+
+static void fsm_dispatch(const struct fsm_event *evt)
+{
+	fsm_handler_t handler = fsm_transitions[state][evt->type];
+
+	/* A timeout posted before the state was left is stale */
+	if (evt->type == EVT_TIMEOUT) {
+		if (!state_deadline || k_uptime_get() < state_deadline) {
+			handler = NULL;
+		} else {
+			fsm_stats[state].timeouts++;
+		}
+	}
+
+	/* An answer queued for an earlier prompt must not apply to the pending request */
+	if (((evt->type == EVT_CONFIRM) || (evt->type == EVT_REJECT)) &&
+	    (evt->prompt != atomic_get(&prompt_seq))) {
+		handler = NULL;
+	}
+
+	if (handler) {
+		enum CURRENT_STATE next = handler(evt);
+
+		if (next != state) {
+			fsm_set_state(next);
+
+			/* Serve the requests queued while waiting for confirmation */
+			if (state == IDLE) {
+				fsm_set_state(serve_requests(evt));
+			}
+		}
+	}
+
+	if (evt->type == EVT_COMMAND) {
+		k_sem_give(&console_cmd_done);
+	}
+
+	if (evt->conn) {
+		bt_conn_unref(evt->conn);
+	}
+}
+
+void main(void)
+{
+	int err = 0;
+
+	/* cJSON allocates from the system heap, CONFIG_HEAP_MEM_POOL_SIZE */
+	cJSON_Init();
+	mem_diag_init();
+	cpu_stats_init();
+
+	configure_gpio();
+
+	if (IS_ENABLED(CONFIG_BT_NUS_UART_CONSOLE)) {
+		err = uart_init();
+		if (err) {
+			error();
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_BT_NUS_SECURITY_ENABLED)) {
+		bt_conn_auth_cb_register(&conn_auth_callbacks);
+	}
+
+	response_sender_init();
+
+	err = bt_enable(NULL);
+	if (err) {
+		error();
+	}
+
+	LOG_INF("Bluetooth initialized%s", "");
+
+	k_sem_give(&ble_init_ok);
+
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		settings_load();
+	}
+
+	err = bt_nus_init(&nus_cb);
+	if (err) {
+		LOG_ERR("Failed to initialize UART service (err: %d)", err);
+		return;
+	}
+
+	err = credential_service_init(&cred_cb);
+	if (err) {
+		LOG_ERR("Failed to initialize credential service (err: %d)", err);
+		return;
+	}
+
+	/* Advertising that fails to start is retried in the background */
+	(void)advertising_start();
+
+	err = store_manager_init();
+	if (err < 0){
+		return;
+	}
+
+	state_entered = k_uptime_get();
+	fsm_stats[IDLE].entries++;
+
+	for(;;){
+		struct fsm_event evt;
+
+		k_msgq_get(&fsm_msgq, &evt, K_FOREVER);
+		fsm_dispatch(&evt);
+	}
 
 	/*for (;;) {
 		dk_set_led(RUN_STATUS_LED, (++blink_status) % 2);
@@ -804,8 +1895,86 @@ void main(void)
 	}*/
 }
 
+/* Console input is assembled into whole lines, whatever the UART buffers it arrives in */
+static uint8_t console_ring[CONFIG_BT_NUS_CONSOLE_RING_SIZE];
+static struct line_assembler console_lines;
+
+BUILD_ASSERT((sizeof(console_ring) & (sizeof(console_ring) - 1)) == 0,
+	     "Console ring buffer size must be a power of two");
+BUILD_ASSERT(sizeof(console_ring) >= CONFIG_BT_NUS_CONSOLE_LINE_MAX,
+	     "Console ring buffer must hold a whole line");
+
+/* Split line in place into at most max words. Returns the number of words or -E2BIG */
+static int console_split(char *line, char **argv, int max)
+{
+	int argc = 0;
+
+	for (;;) {
+		while (*line == ' ' || *line == '\t') {
+			*line++ = '\0';
+		}
+		if (!*line) {
+			return argc;
+		}
+		if (argc == max) {
+			return -E2BIG;
+		}
+		argv[argc++] = line;
+		while (*line && *line != ' ' && *line != '\t') {
+			line++;
+		}
+	}
+}
+
+static const struct console_cmd_desc *console_cmd_find(const char *name)
+{
+	for (int i = 0; i < ARRAY_SIZE(console_cmds); i++) {
+		if (strcmp(console_cmds[i].name, name) == 0) {
+			return &console_cmds[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void console_command(const char *line)
+{
+	const struct console_cmd_desc *desc;
+	int argc;
+
+	strcpy(console_cmd.line, line);
+	argc = console_split(console_cmd.line, console_cmd.argv, ARRAY_SIZE(console_cmd.argv));
+	desc = (argc > 0) ? console_cmd_find(console_cmd.argv[0]) : NULL;
+
+	if (desc) {
+		if (argc < 0 || argc - 1 < desc->min_args || argc - 1 > desc->max_args) {
+			console_out_printf("Usage: %s\n", desc->usage);
+			return;
+		}
+
+		console_cmd.desc = desc;
+		console_cmd.argc = argc;
+		/* console_cmd is only reused once the main thread is done with it */
+		if (!fsm_post(EVT_COMMAND, NULL)) {
+			k_sem_take(&console_cmd_done, K_FOREVER);
+		}
+		return;
+	}
+
+	/* The state machine ignores the events that do not apply to its state */
+	if(line[0]=='Y' || line[0]=='y'){
+		fsm_post_answer(EVT_CONFIRM);
+	}else{
+		fsm_post_answer(EVT_REJECT);
+	}
+}
+
 void ble_write_thread(void)
 {
+	char line[CONFIG_BT_NUS_CONSOLE_LINE_MAX];
+
+	line_assembler_init(&console_lines, console_ring, sizeof(console_ring));
+
 	/* Don't go any further until BLE is initialized */
 	k_sem_take(&ble_init_ok, K_FOREVER);
 
@@ -814,93 +1983,50 @@ void ble_write_thread(void)
 		struct uart_data_t *buf = k_fifo_get(&fifo_uart_rx_data,
 						     K_FOREVER);
 
-		char pwd_msg[12+strlen(pwdStruct.pwd)];
-
-		k_mutex_lock(&state_mutex, K_FOREVER);
-		switch(state){
-			case IDLE:
-				k_mutex_unlock(&state_mutex);
-				if( buf->len < UART_BUF_SIZE) buf->data[buf->len] = '\0';
-				if( buf->data[buf->len - 1] == '\r' || buf->data[buf->len - 1] == '\n'){
-					buf->data[buf->len - 1] = '\0';
-					if( buf->len > 1 && (buf->data[buf->len - 2] == '\r' || buf->data[buf->len - 2] == '\n') ){
-						buf->data[buf->len - 2] = '\0';
-					}
-				}
+		for (size_t pos = 0; pos < buf->len;) {
+			int len;
 
-				if(strcmp((char *) buf->data, "clear storage") == 0){
-					k_mutex_lock(&state_mutex, K_FOREVER);
-					state = WAITING_DELETE_ALL;
-					k_mutex_unlock(&state_mutex);
-					printk("Are you sure you want to delete ALL passwords?\nTo confirm/reject, type Y/n\n");
-				}else if(strcmp((char *) buf->data, "list") == 0){
-					k_mutex_lock(&state_mutex, K_FOREVER);
-					state = WAITING_SHOW_LIST;
-					k_mutex_unlock(&state_mutex);
-					k_sem_give(&sem);
+			pos += line_assembler_put(&console_lines, &buf->data[pos], buf->len - pos);
+
+			/* Whole lines are taken out, which leaves room for the rest of the buffer */
+			while ((len = line_assembler_get(&console_lines, line, sizeof(line))) != -EAGAIN) {
+				if (len < 0) {
+					console_out_printf("Command too long. Maximum length is %d characters\n",
+							   CONFIG_BT_NUS_CONSOLE_LINE_MAX - 1);
+					continue;
 				}
-				break;
 
-			case WAITING_DELETE_ALL:
-				k_mutex_unlock(&state_mutex);
-				if( buf->len < UART_BUF_SIZE) buf->data[buf->len] = '\0';
-				if(buf->data[0]=='Y' || buf->data[0]=='y'){
-					k_mutex_lock(&state_mutex, K_FOREVER);
-					state = DELETE_ALL_CONFIRMED;
-					k_mutex_unlock(&state_mutex);
+				console_command(line);
+			}
+		}
 
-					k_sem_give(&sem);
-				}
-				break;
+		uart_buf_free(&uart_rx_pool, buf);
+	}
+}
 
-			case WAITING_GET_PWD_CONF:
-				state = IDLE;
-				k_mutex_unlock(&state_mutex);
-
-				if( buf->len < UART_BUF_SIZE) buf->data[buf->len] = '\0';
-				if(buf->data[0]=='Y' || buf->data[0]=='y'){
-					strcpy(pwd_msg, "{\"pwd\": \"" );
-					strcpy(pwd_msg + 9, pwdStruct.pwd);
-					strcpy(pwd_msg + 9 + strlen(pwdStruct.pwd), "\"}");
-					strcpy(pwdStruct.pwd, ""); /* Must be empty for future uses */
-					
-					if (bt_nus_send(NULL, pwd_msg, strlen(pwd_msg))) {
-						LOG_WRN("Failed to send data over BLE connection (%d)", 99);
-					}else{
-						printk("Password sent to client\n");
-					}
-				}else{
-					if (bt_nus_send(NULL, ERR_OPERATION_REJECTED, strlen(ERR_OPERATION_REJECTED))) {
-						LOG_WRN("Failed to send data over BLE connection (%d)", 99);
-					}
-				}
-				break;
+void ble_rx_thread(void)
+{
+	struct ble_rx_chunk_t chunk;
 
-			case WAITING_STORE_PWD_CONF:
-				state = IDLE;
-				k_mutex_unlock(&state_mutex);
-
-				if( buf->len < UART_BUF_SIZE) buf->data[buf->len] = '\0';
-				if(buf->data[0]=='Y' || buf->data[0]=='y'){
-					k_sem_give(&sem);
-				}else{
-					printk("Password storage cancelled\n");
-					if (bt_nus_send(NULL, ERR_OPERATION_REJECTED, strlen(ERR_OPERATION_REJECTED))) {
-						LOG_WRN("Failed to send data over BLE connection (%d)", 99);
-					}else{
-						printk("Sent: %s\n", ERR_OPERATION_REJECTED);
-					}
-				}
-				break;
+	for (;;) {
+		/* Wait indefinitely for data received over bluetooth */
+		k_msgq_get(&ble_rx_msgq, &chunk, K_FOREVER);
 
-			default:
-				k_mutex_unlock(&state_mutex);
-				break;
-		}
+		uint32_t start = k_cycle_get_32();
+
+		ble_rx_process(chunk.conn, chunk.data, chunk.len, chunk.rx_cycles);
+		bt_conn_unref(chunk.conn);
+
+		uint32_t cycles = k_cycle_get_32() - start;
 
-		k_free(buf);
+		rx_stats.proc_count++;
+		rx_stats.proc_cycles_total += cycles;
+		rx_stats.proc_cycles_max = MAX(rx_stats.proc_cycles_max, cycles);
 	}
 }
 
 K_THREAD_DEFINE(ble_write_thread_id, STACKSIZE, ble_write_thread, NULL, NULL,
 		NULL, PRIORITY, 0, 0);
+
+K_THREAD_DEFINE(ble_rx_thread_id, CONFIG_BT_NUS_RX_THREAD_STACK_SIZE, ble_rx_thread, NULL, NULL,
+		NULL, PRIORITY, 0, 0);
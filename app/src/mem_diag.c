@@ -0,0 +1,165 @@
+/** @file
+ *  @brief Stack and heap usage reporting
+ *
+ *  Stack high-water marks come from the stack painting done with CONFIG_INIT_STACKS.
+ *  cJSON, the only user of the system heap (k_malloc, CONFIG_HEAP_MEM_POOL_SIZE
+ *  bytes), allocates through hooks that account for the size of every block in a
+ *  header in front of it. Zephyr 2.7 keeps no usage statistics of the heap itself.
+ */
+#include "mem_diag.h"
+#include "console_out.h"
+
+#include <cJSON.h>
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(mem_diag);
+
+/* Keeps the blocks handed to cJSON aligned like the ones malloc returns */
+struct heap_block_hdr {
+	size_t size;
+	size_t reserved;
+};
+
+static struct mem_diag_heap_stats heap_stats;
+static struct k_spinlock heap_lock;
+
+static void *tracked_malloc(size_t size)
+{
+	struct heap_block_hdr *hdr = k_malloc(sizeof(*hdr) + size);
+	k_spinlock_key_t key = k_spin_lock(&heap_lock);
+
+	if (hdr) {
+		hdr->size = sizeof(*hdr) + size;
+		heap_stats.used += hdr->size;
+		heap_stats.max_used = MAX(heap_stats.max_used, heap_stats.used);
+		heap_stats.allocs++;
+	} else {
+		heap_stats.failures++;
+	}
+
+	k_spin_unlock(&heap_lock, key);
+
+	return hdr ? &hdr[1] : NULL;
+}
+
+static void tracked_free(void *ptr)
+{
+	struct heap_block_hdr *hdr;
+
+	if (!ptr) {
+		return;
+	}
+
+	hdr = (struct heap_block_hdr *)ptr - 1;
+
+	k_spinlock_key_t key = k_spin_lock(&heap_lock);
+
+	heap_stats.used -= hdr->size;
+
+	k_spin_unlock(&heap_lock, key);
+
+	k_free(hdr);
+}
+
+void mem_diag_heap_stats_get(struct mem_diag_heap_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&heap_lock);
+
+	*stats = heap_stats;
+
+	k_spin_unlock(&heap_lock, key);
+}
+
+/* Stack size and high-water mark of a thread. Returns false if unknown */
+static bool thread_stack_usage(const struct k_thread *thread, size_t *size, size_t *used)
+{
+	size_t unused;
+
+	if (k_thread_stack_space_get(thread, &unused)) {
+		return false;
+	}
+
+	*size = thread->stack_info.size;
+	*used = *size - unused;
+
+	return true;
+}
+
+static const char *thread_name(const struct k_thread *thread)
+{
+	const char *name = k_thread_name_get((k_tid_t)thread);
+
+	return (name && name[0]) ? name : "?";
+}
+
+static void thread_print(const struct k_thread *thread, void *user_data)
+{
+	size_t size;
+	size_t used;
+
+	if (thread_stack_usage(thread, &size, &used)) {
+		console_out_printf("\t%-24s %5u/%5u (%u%%)\n", thread_name(thread), used, size,
+				   used * 100 / size);
+	}
+}
+
+static void thread_log(const struct k_thread *thread, void *user_data)
+{
+	size_t size;
+	size_t used;
+
+	if (thread_stack_usage(thread, &size, &used)) {
+		LOG_INF("%s: %u/%u stack bytes used", log_strdup(thread_name(thread)), used, size);
+	}
+}
+
+void mem_diag_print(void)
+{
+	struct mem_diag_heap_stats stats;
+
+	console_out_printf("Stack high-water marks (used/size bytes):\n");
+	k_thread_foreach_unlocked(thread_print, NULL);
+
+	mem_diag_heap_stats_get(&stats);
+	console_out_printf("System heap: %u/%u bytes used, max %u, %u allocations, %u failures\n",
+			   stats.used, CONFIG_HEAP_MEM_POOL_SIZE, stats.max_used, stats.allocs,
+			   stats.failures);
+}
+
+void mem_diag_log(void)
+{
+	struct mem_diag_heap_stats stats;
+
+	k_thread_foreach_unlocked(thread_log, NULL);
+
+	mem_diag_heap_stats_get(&stats);
+	LOG_INF("System heap: %u/%u bytes used, max %u, %u allocations, %u failures",
+		stats.used, CONFIG_HEAP_MEM_POOL_SIZE, stats.max_used, stats.allocs,
+		stats.failures);
+}
+
+#if CONFIG_BT_NUS_MEM_DIAG_LOG_INTERVAL > 0
+static void mem_diag_report(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(mem_diag_work, mem_diag_report);
+
+static void mem_diag_report(struct k_work *work)
+{
+	mem_diag_log();
+	k_work_reschedule(&mem_diag_work, K_SECONDS(CONFIG_BT_NUS_MEM_DIAG_LOG_INTERVAL));
+}
+#endif
+
+void mem_diag_init(void)
+{
+	cJSON_Hooks hooks = {
+		.malloc_fn = tracked_malloc,
+		.free_fn = tracked_free,
+	};
+
+	cJSON_InitHooks(&hooks);
+
+#if CONFIG_BT_NUS_MEM_DIAG_LOG_INTERVAL > 0
+	k_work_reschedule(&mem_diag_work, K_SECONDS(CONFIG_BT_NUS_MEM_DIAG_LOG_INTERVAL));
+#endif
+}
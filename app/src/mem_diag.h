@@ -0,0 +1,63 @@
+#ifndef MEM_DIAG_H_
+#define MEM_DIAG_H_
+
+#include <zephyr.h>
+
+/**
+ * @brief Usage of the system heap (k_malloc), which cJSON allocates from
+ */
+struct mem_diag_heap_stats {
+	/** Bytes currently allocated, with the accounting headers */
+	size_t used;
+	/** Highest number of bytes allocated at once */
+	size_t max_used;
+	/** Successful allocations */
+	uint32_t allocs;
+	/** Failed allocations */
+	uint32_t failures;
+};
+
+#if defined(CONFIG_BT_NUS_MEM_DIAG)
+
+/**
+ * @brief Allocate cJSON from the system heap, track its allocations and start the
+ *	  periodic memory report
+ *
+ * Must be called before cJSON is used.
+ */
+void mem_diag_init(void);
+
+/**
+ * @brief Get the heap usage
+ *
+ * @param stats Heap statistics
+ */
+void mem_diag_heap_stats_get(struct mem_diag_heap_stats *stats);
+
+/**
+ * @brief Print the stack high-water mark of every thread and the heap usage on the console
+ */
+void mem_diag_print(void);
+
+/**
+ * @brief Log the stack high-water mark of every thread and the heap usage
+ */
+void mem_diag_log(void);
+
+#else
+
+static inline void mem_diag_init(void)
+{
+}
+
+static inline void mem_diag_print(void)
+{
+}
+
+static inline void mem_diag_log(void)
+{
+}
+
+#endif /* CONFIG_BT_NUS_MEM_DIAG */
+
+#endif /* MEM_DIAG_H_ */
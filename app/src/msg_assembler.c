@@ -0,0 +1,58 @@
+/** @file
+ *  @brief Reassembly of the JSON messages received over BLE
+ */
+#include "msg_assembler.h"
+
+#include <errno.h>
+#include <string.h>
+
+void msg_assembler_reset(struct msg_assembler *ma)
+{
+	ma->len = 0;
+	ma->depth = 0;
+	ma->in_str = false;
+	ma->escaped = false;
+	ma->buf[0] = '\0';
+}
+
+/* Track the nesting level of the message. Braces inside strings are ignored */
+static void msg_assembler_scan(struct msg_assembler *ma, const char *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (ma->in_str) {
+			if (ma->escaped) {
+				ma->escaped = false;
+			} else if (data[i] == '\\') {
+				ma->escaped = true;
+			} else if (data[i] == '"') {
+				ma->in_str = false;
+			}
+		} else if (data[i] == '"') {
+			ma->in_str = true;
+		} else if (data[i] == '{') {
+			ma->depth++;
+		} else if (data[i] == '}') {
+			ma->depth--;
+		}
+	}
+}
+
+int msg_assembler_put(struct msg_assembler *ma, const char *data, size_t len)
+{
+	if ((ma->len == 0) && ((len == 0) || (data[0] != '{'))) {
+		/* Not the first fragment of a message */
+		return -ENOMSG;
+	}
+
+	if ((ma->len + len) >= sizeof(ma->buf)) {
+		msg_assembler_reset(ma);
+		return -EMSGSIZE;
+	}
+
+	memcpy(&ma->buf[ma->len], data, len);
+	msg_assembler_scan(ma, data, len);
+	ma->len += len;
+	ma->buf[ma->len] = '\0';
+
+	return (ma->depth > 0) ? 0 : (int)ma->len;
+}
@@ -0,0 +1,62 @@
+#ifndef MSG_ASSEMBLER_H_
+#define MSG_ASSEMBLER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MSG_RCV_BUFF_SIZE 1024
+
+/**
+ * @brief Reassembles a JSON message received in several fragments
+ *
+ * A message starts with a fragment beginning with '{' and is complete once its
+ * braces are balanced. Braces inside strings are ignored. The message is kept
+ * NUL terminated in buf. Does not depend on Zephyr, so it can be built on the host.
+ */
+struct msg_assembler {
+	/** Message being reassembled */
+	char buf[MSG_RCV_BUFF_SIZE];
+	size_t len;
+	/** Nesting level of the braces received so far */
+	int depth;
+	/** Inside a string, right after a backslash in a string */
+	bool in_str;
+	bool escaped;
+};
+
+/**
+ * @brief Discard any partially received message
+ *
+ * @param ma Message assembler
+ */
+void msg_assembler_reset(struct msg_assembler *ma);
+
+/**
+ * @brief Add a received fragment
+ *
+ * Once a message is complete it stays in buf until msg_assembler_reset() is called,
+ * which must be done before adding the fragments of the next message.
+ *
+ * @param ma   Message assembler
+ * @param data Fragment
+ * @param len  Length of the fragment
+ *
+ * @return Length of the message if it is complete, 0 if more fragments are needed,
+ *         -ENOMSG if the fragment was discarded because it does not start a message,
+ *         -EMSGSIZE if the message exceeds the buffer. It is then discarded
+ */
+int msg_assembler_put(struct msg_assembler *ma, const char *data, size_t len);
+
+/**
+ * @brief Check whether no message is being received
+ *
+ * @param ma Message assembler
+ *
+ * @return true if the next fragment must start a new message
+ */
+static inline bool msg_assembler_idle(const struct msg_assembler *ma)
+{
+	return ma->len == 0;
+}
+
+#endif /* MSG_ASSEMBLER_H_ */
@@ -0,0 +1,115 @@
+/** @file
+ *  @brief Parsing of the JSON requests received over BLE
+ */
+#include "request_parser.h"
+#include "console_out.h"
+
+#include <errno.h>
+#include <string.h>
+#include <cJSON.h>
+
+/* Fill the batch request with the (url, user) pairs of a batch get message */
+static int request_parse_batch(const cJSON *json_batch, struct TBatchRequest *batch)
+{
+	const cJSON *json_entry;
+	int len = 0;
+
+	cJSON_ArrayForEach(json_entry, json_batch) {
+		const cJSON *json_url = cJSON_GetObjectItemCaseSensitive(json_entry, "url");
+		const cJSON *json_username = cJSON_GetObjectItemCaseSensitive(json_entry, "user");
+
+		if ((len == BATCH_MAX_SIZE) ||
+		    !cJSON_IsString(json_url) || (json_url->valuestring == NULL) ||
+		    !cJSON_IsString(json_username) || (json_username->valuestring == NULL) ||
+		    (strlen(json_url->valuestring) > URL_SIZE) ||
+		    (strlen(json_username->valuestring) > USERNAME_SIZE)) {
+			return -EINVAL;
+		}
+
+		strcpy(batch->entries[len].url, json_url->valuestring);
+		strcpy(batch->entries[len].username, json_username->valuestring);
+		strcpy(batch->entries[len].pwd, "");
+		batch->found[len] = false;
+		len++;
+	}
+
+	batch->len = len;
+
+	return (len > 0) ? 0 : -EINVAL;
+}
+
+/* Parse JSON
+Messages must be composed of 2 or 3 string values (depending on the type of message). Keys must be "username", "url" and (optionally) "pwd"
+Example: {"url": "myurl.something", "username": "myusername"} or {"username": "myusername", "url": "myurl.something", "pwd": "mypassword"}
+A batch get request contains an array of (url, user) pairs under the "batch" key
+Example: {"batch": [{"url": "myurl.something", "user": "myusername"}, {"url": "other.something", "user": "otheruser"}]}
+A search request lists the stored (url, user) pairs whose URL starts with the given prefix
+Example: {"search": "myurl"}*/
+int request_parse(const char *msg, struct TRequest *request)
+{
+	int err = 0;
+	cJSON *monitor_json = cJSON_Parse(msg);
+
+	if(monitor_json == NULL){
+		console_out_printf("Error parsing JSON message\n");
+		return -EINVAL;
+	}
+
+	const cJSON *json_batch = cJSON_GetObjectItemCaseSensitive(monitor_json, "batch");
+	const cJSON *json_search = cJSON_GetObjectItemCaseSensitive(monitor_json, "search");
+	const cJSON *json_url = cJSON_GetObjectItemCaseSensitive(monitor_json, "url");
+	const cJSON *json_username = cJSON_GetObjectItemCaseSensitive(monitor_json, "user");
+	const cJSON *json_pwd = cJSON_GetObjectItemCaseSensitive(monitor_json, "pwd");
+
+	if(cJSON_IsArray(json_batch)){
+		/* It's a batch get request */
+		request->type = REQUEST_GET_BATCH;
+		err = request_parse_batch(json_batch, &request->batch);
+		if(err){
+			console_out_printf("Message error. Make sure the batch is not empty, does not exceed %d entries and its fields do not exceed the maximum allowed length\n", BATCH_MAX_SIZE);
+		}
+	}else if(cJSON_IsString(json_search) && (json_search->valuestring != NULL)){
+		/* It's a search request */
+		if(strlen(json_search->valuestring) <= URL_SIZE){
+			request->type = REQUEST_SEARCH;
+			strcpy(request->pwd.url, json_search->valuestring);
+		}else{
+			console_out_printf("Message error. Make sure the fields do not exceed the maximum allowed length\n");
+			err = -EINVAL;
+		}
+	}else if( cJSON_IsString(json_url) && (json_url->valuestring != NULL) && cJSON_IsString(json_username) && (json_username->valuestring != NULL) ){
+		/* It's a correct message */
+		if(cJSON_IsString(json_pwd) && (json_pwd->valuestring != NULL)){
+			/* It's a password register request */
+			if( (strlen(json_url->valuestring) <= URL_SIZE) && (strlen(json_username->valuestring) <= USERNAME_SIZE) && (strlen(json_pwd->valuestring) <= PWD_SIZE) ){
+				request->type = REQUEST_STORE;
+				strcpy(request->pwd.pwd, json_pwd->valuestring);
+				strcpy(request->pwd.url, json_url->valuestring);
+				strcpy(request->pwd.username, json_username->valuestring);
+			}else{
+				console_out_printf("Message error. Make sure the fields do not exceed the maximum allowed length\n");
+				err = -EINVAL;
+			}
+
+		}else{
+			/* It's a password get request */
+			if( (strlen(json_url->valuestring) <= URL_SIZE) && (strlen(json_username->valuestring) <= USERNAME_SIZE) ){
+				request->type = REQUEST_GET;
+				strcpy(request->pwd.url, json_url->valuestring);
+				strcpy(request->pwd.username, json_username->valuestring);
+				strcpy(request->pwd.pwd, "");
+			}else{
+				console_out_printf("Message error. Make sure the fields do not exceed the maximum allowed length\n");
+				err = -EINVAL;
+			}
+
+		}
+	}else{
+		console_out_printf("Wrong message format\n");
+		err = -EINVAL;
+	}
+
+	cJSON_Delete(monitor_json);
+
+	return err;
+}
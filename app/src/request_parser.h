@@ -0,0 +1,42 @@
+#ifndef REQUEST_PARSER_H_
+#define REQUEST_PARSER_H_
+
+#include "storage_manager.h"
+
+#include <stdbool.h>
+
+#define BATCH_MAX_SIZE CONFIG_BT_NUS_BATCH_MAX_ENTRIES
+
+/* Batch get request: several (url, user) pairs approved with a single confirmation.
+ * Also holds the (url, user) pairs found by a search request
+ */
+struct TBatchRequest {
+	struct TPassword entries[BATCH_MAX_SIZE];
+	bool found[BATCH_MAX_SIZE];
+	int len;
+	/* Passwords matching a search request, which may be more than len */
+	int total;
+};
+
+enum REQUEST_TYPE {REQUEST_GET, REQUEST_STORE, REQUEST_GET_BATCH, REQUEST_SEARCH};
+
+/* Request received from a client, waiting to be served */
+struct TRequest {
+	enum REQUEST_TYPE type;
+	struct TPassword pwd;
+	struct TBatchRequest batch;
+};
+
+/**
+ * @brief Parse a complete JSON message into a request
+ *
+ * Only depends on cJSON and the console output, so it can be built on the host.
+ *
+ * @param msg     NUL terminated message
+ * @param request Request to fill in
+ *
+ * @return 0 on success, -EINVAL if the message is not a valid request
+ */
+int request_parse(const char *msg, struct TRequest *request);
+
+#endif /* REQUEST_PARSER_H_ */
@@ -0,0 +1,167 @@
+/** @file
+ *  @brief Fragmented and flow-controlled BLE response sender
+ */
+#include "response_sender.h"
+#include "conn_params.h"
+#include "credential_service.h"
+
+#include <bluetooth/services/nus.h>
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(response_sender);
+
+#define TX_MAX_IN_FLIGHT CONFIG_BT_NUS_TX_MAX_IN_FLIGHT
+#define TX_TIMEOUT K_MSEC(CONFIG_BT_NUS_TX_TIMEOUT)
+#define TX_RETRY_DELAY K_MSEC(10)
+
+/* Notifications that can still be queued, per connection */
+static struct k_sem tx_credits[CONFIG_BT_MAX_CONN];
+
+/* Service the responses are sent through, per connection */
+static enum response_transport transports[CONFIG_BT_MAX_CONN];
+
+/* Keeps the fragments of a response together. A stalled connection only blocks its own
+ * responses
+ */
+static struct k_mutex send_mutexes[CONFIG_BT_MAX_CONN];
+
+static struct response_sender_stats stats;
+static struct k_spinlock stats_lock;
+
+#define STATS_ADD(field, value)						\
+	do {								\
+		k_spinlock_key_t key = k_spin_lock(&stats_lock);	\
+		stats.field += (value);					\
+		k_spin_unlock(&stats_lock, key);			\
+	} while (0)
+
+static int send_fragment(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	int err;
+	struct k_sem *credits = &tx_credits[bt_conn_index(conn)];
+
+	/* Wait until the controller has room for one more notification */
+	if (k_sem_take(credits, TX_TIMEOUT)) {
+		STATS_ADD(timeouts, 1);
+		return -ETIMEDOUT;
+	}
+
+	for (int retry = 0;; retry++) {
+		if (transports[bt_conn_index(conn)] == RESPONSE_TRANSPORT_CREDENTIAL_SERVICE) {
+			err = credential_service_send(conn, data, len);
+		} else {
+			err = bt_nus_send(conn, data, len);
+		}
+		if ((err != -ENOMEM) || (retry == CONFIG_BT_NUS_TX_RETRIES)) {
+			break;
+		}
+
+		STATS_ADD(retries, 1);
+		k_sleep(TX_RETRY_DELAY);
+	}
+
+	if (err) {
+		k_sem_give(credits);
+		STATS_ADD(failures, 1);
+		return err;
+	}
+
+	STATS_ADD(fragments, 1);
+	STATS_ADD(bytes, len);
+
+	return 0;
+}
+
+int response_send(struct bt_conn *conn, const uint8_t *data, size_t len)
+{
+	int err = 0;
+
+	if (!conn) {
+		return -ENOTCONN;
+	}
+
+	uint16_t fragment_size = bt_nus_get_mtu(conn);
+	struct k_mutex *send_mutex = &send_mutexes[bt_conn_index(conn)];
+	uint32_t start = k_cycle_get_32();
+
+	k_mutex_lock(send_mutex, K_FOREVER);
+
+	for (size_t pos = 0; pos < len;) {
+		uint16_t fragment_len = MIN(len - pos, fragment_size);
+
+		err = send_fragment(conn, &data[pos], fragment_len);
+		if (err) {
+			LOG_WRN("Response aborted after %u of %u bytes (err %d)",
+				(uint32_t)pos, (uint32_t)len, err);
+			break;
+		}
+
+		pos += fragment_len;
+	}
+
+	if (!err) {
+		STATS_ADD(responses, 1);
+		conn_params_response_sent(conn);
+	}
+	STATS_ADD(send_time_us, k_cyc_to_us_floor32(k_cycle_get_32() - start));
+
+	k_mutex_unlock(send_mutex);
+
+	return err;
+}
+
+void response_sender_init(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(send_mutexes); i++) {
+		k_mutex_init(&send_mutexes[i]);
+	}
+}
+
+void response_sender_on_sent(struct bt_conn *conn)
+{
+	k_sem_give(&tx_credits[bt_conn_index(conn)]);
+}
+
+void response_sender_conn_init(struct bt_conn *conn)
+{
+	k_sem_init(&tx_credits[bt_conn_index(conn)], TX_MAX_IN_FLIGHT, TX_MAX_IN_FLIGHT);
+	transports[bt_conn_index(conn)] = RESPONSE_TRANSPORT_NUS;
+}
+
+void response_sender_set_transport(struct bt_conn *conn, enum response_transport transport)
+{
+	transports[bt_conn_index(conn)] = transport;
+}
+
+void response_sender_reset(struct bt_conn *conn)
+{
+	/* Wake up any sender still waiting, the connection is gone */
+	for (int i = 0; i < TX_MAX_IN_FLIGHT; i++) {
+		k_sem_give(&tx_credits[bt_conn_index(conn)]);
+	}
+}
+
+void response_sender_stats_get(struct response_sender_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*out = stats;
+	k_spin_unlock(&stats_lock, key);
+}
+
+void response_sender_stats_log(void)
+{
+	struct response_sender_stats s;
+
+	response_sender_stats_get(&s);
+
+	if (!s.send_time_us) {
+		return;
+	}
+
+	LOG_INF("BLE TX: %u responses, %u notifications, %u bytes, %u B/s",
+		s.responses, s.fragments, s.bytes,
+		(uint32_t)((uint64_t)s.bytes * USEC_PER_SEC / s.send_time_us));
+	LOG_INF("BLE TX: %u retries, %u failures, %u timeouts",
+		s.retries, s.failures, s.timeouts);
+}
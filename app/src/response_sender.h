@@ -0,0 +1,102 @@
+#ifndef RESPONSE_SENDER_H_
+#define RESPONSE_SENDER_H_
+
+#include <zephyr.h>
+#include <bluetooth/conn.h>
+
+/**
+ * @brief Service used to send the responses to a connection
+ */
+enum response_transport {
+	/** Nordic UART Service, compatibility fallback */
+	RESPONSE_TRANSPORT_NUS,
+	/** Credential service */
+	RESPONSE_TRANSPORT_CREDENTIAL_SERVICE,
+};
+
+/**
+ * @brief Response sender statistics
+ */
+struct response_sender_stats {
+	/** Responses completely sent */
+	uint32_t responses;
+	/** Notifications sent */
+	uint32_t fragments;
+	/** Payload bytes sent */
+	uint32_t bytes;
+	/** Notifications retried because the stack was out of buffers */
+	uint32_t retries;
+	/** Responses aborted because a notification could not be sent */
+	uint32_t failures;
+	/** Responses aborted waiting for a notification to complete */
+	uint32_t timeouts;
+	/** Time spent sending, used to compute the throughput */
+	uint64_t send_time_us;
+};
+
+/**
+ * @brief Initialize the response sender. Must be called before Bluetooth is enabled
+ */
+void response_sender_init(void);
+
+/**
+ * @brief Send a response to the given connection
+ *
+ * The response is split in as many notifications as needed to fit the ATT MTU.
+ * Only CONFIG_BT_NUS_TX_MAX_IN_FLIGHT notifications are queued at the same time,
+ * the next one is sent when a previous one completes. Responses to different
+ * connections are sent independently: waiting for one connection does not delay
+ * the others.
+ *
+ * @param conn Connection to send the response to
+ * @param data Response payload
+ * @param len  Response length
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int response_send(struct bt_conn *conn, const uint8_t *data, size_t len);
+
+/**
+ * @brief Notify that a notification has been sent. Must be called from the NUS sent callback
+ *
+ * @param conn Connection the notification was sent to
+ */
+void response_sender_on_sent(struct bt_conn *conn);
+
+/**
+ * @brief Prepare the sender for a new connection. Must be called on connection
+ *
+ * @param conn New connection
+ */
+void response_sender_conn_init(struct bt_conn *conn);
+
+/**
+ * @brief Select the service used to send the responses to a connection
+ *
+ * Responses are sent through the service the last request was received from.
+ *
+ * @param conn      Connection
+ * @param transport Service used to send the responses
+ */
+void response_sender_set_transport(struct bt_conn *conn, enum response_transport transport);
+
+/**
+ * @brief Release the notifications still in flight. Must be called on disconnection
+ *
+ * @param conn Disconnected connection
+ */
+void response_sender_reset(struct bt_conn *conn);
+
+/**
+ * @brief Get a copy of the response sender statistics
+ *
+ * @param stats Struct in which the statistics will be copied
+ */
+void response_sender_stats_get(struct response_sender_stats *stats);
+
+/**
+ * @brief Log the response sender statistics
+ */
+void response_sender_stats_log(void);
+
+#endif /* RESPONSE_SENDER_H_ */
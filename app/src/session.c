@@ -0,0 +1,250 @@
+/** @file
+ *  @brief Per-connection sessions and round-robin request scheduling
+ */
+#include "session.h"
+#include "console_out.h"
+
+static struct session sessions[CONFIG_BT_MAX_CONN];
+static K_MUTEX_DEFINE(session_mutex);
+
+/* Index of the last session served */
+static int last_served;
+
+/* Requests served without confirmation since boot */
+static uint32_t approval_served_total;
+
+static void approval_end(struct session *s)
+{
+	if (!s->approval_until) {
+		return;
+	}
+
+	console_out_printf("Approval session for %s ended. %u requests served without confirmation\n",
+			   s->addr, s->approval_served);
+
+	s->approval_until = 0;
+	s->approval_url[0] = '\0';
+	s->approval_served = 0;
+}
+
+struct session *session_open(struct bt_conn *conn)
+{
+	struct session *s = &sessions[bt_conn_index(conn)];
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	if (s->conn) {
+		k_mutex_unlock(&session_mutex);
+		return NULL;
+	}
+
+	memset(s, 0, sizeof(*s));
+	s->conn = bt_conn_ref(conn);
+	s->sec_level = bt_conn_get_security(conn);
+	bt_addr_le_to_str(bt_conn_get_dst(conn), s->addr, sizeof(s->addr));
+
+	k_mutex_unlock(&session_mutex);
+
+	return s;
+}
+
+void session_close(struct bt_conn *conn)
+{
+	struct session *s = &sessions[bt_conn_index(conn)];
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	if (s->conn == conn) {
+		approval_end(s);
+		bt_conn_unref(s->conn);
+		/* The session may contain confidential information */
+		memset(s, 0, sizeof(*s));
+	}
+
+	k_mutex_unlock(&session_mutex);
+}
+
+struct session *session_get(struct bt_conn *conn)
+{
+	struct session *s = &sessions[bt_conn_index(conn)];
+
+	return (s->conn == conn) ? s : NULL;
+}
+
+int session_submit(struct session *s)
+{
+	int err = 0;
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	if (s->busy) {
+		err = -EBUSY;
+	} else {
+		s->busy = true;
+		s->queued = true;
+	}
+
+	k_mutex_unlock(&session_mutex);
+
+	return err;
+}
+
+struct session *session_next_pending(void)
+{
+	struct session *next = NULL;
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	for (int i = 1; i <= ARRAY_SIZE(sessions); i++) {
+		int index = (last_served + i) % ARRAY_SIZE(sessions);
+
+		if (sessions[index].conn && sessions[index].queued) {
+			next = &sessions[index];
+			next->queued = false;
+			last_served = index;
+			break;
+		}
+	}
+
+	k_mutex_unlock(&session_mutex);
+
+	return next;
+}
+
+void session_done(struct session *s)
+{
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	memset(&s->request, 0, sizeof(s->request));
+	s->busy = false;
+	s->queued = false;
+
+	k_mutex_unlock(&session_mutex);
+}
+
+struct bond_search {
+	const bt_addr_le_t *addr;
+	bool found;
+};
+
+static void bond_find(const struct bt_bond_info *info, void *user_data)
+{
+	struct bond_search *search = user_data;
+
+	if (!bt_addr_le_cmp(search->addr, &info->addr)) {
+		search->found = true;
+	}
+}
+
+/* The peer is bonded and the link is encrypted, with the keys of the bond */
+static bool is_bonded(const struct session *s)
+{
+	struct bond_search search = {
+		.addr = bt_conn_get_dst(s->conn),
+	};
+
+	if (s->sec_level < BT_SECURITY_L2) {
+		return false;
+	}
+
+	bt_foreach_bond(BT_ID_DEFAULT, bond_find, &search);
+
+	return search.found;
+}
+
+int session_approval_start(struct session *s, const char *url)
+{
+	if (!is_bonded(s)) {
+		return -EPERM;
+	}
+
+	if (IS_ENABLED(CONFIG_BT_NUS_APPROVAL_SESSION_PER_URL) && !url) {
+		return -EPERM;
+	}
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	if (s->approval_until) {
+		/* Extend the current approval session */
+		s->approval_until = k_uptime_get() + CONFIG_BT_NUS_APPROVAL_SESSION_TIMEOUT * MSEC_PER_SEC;
+		k_mutex_unlock(&session_mutex);
+		return -EALREADY;
+	}
+
+	s->approval_until = k_uptime_get() + CONFIG_BT_NUS_APPROVAL_SESSION_TIMEOUT * MSEC_PER_SEC;
+	s->approval_served = 0;
+	if (IS_ENABLED(CONFIG_BT_NUS_APPROVAL_SESSION_PER_URL)) {
+		strcpy(s->approval_url, url);
+	} else {
+		s->approval_url[0] = '\0';
+	}
+
+	k_mutex_unlock(&session_mutex);
+
+	return 0;
+}
+
+bool session_approval_check(struct session *s)
+{
+	const char *url;
+	bool approved = false;
+
+	if (!IS_ENABLED(CONFIG_BT_NUS_APPROVAL_SESSION)) {
+		return false;
+	}
+
+	/* The user approved getting passwords, not disclosing what is stored */
+	if (s->request.type == REQUEST_GET) {
+		url = s->request.pwd.url;
+	} else if (s->request.type == REQUEST_GET_BATCH) {
+		url = NULL;
+	} else {
+		return false;
+	}
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	if (s->approval_until && (k_uptime_get() >= s->approval_until)) {
+		approval_end(s);
+	}
+
+	if (s->approval_until &&
+	    ((s->approval_url[0] == '\0') || (url && !strcmp(s->approval_url, url)))) {
+		approved = true;
+		s->approval_served++;
+		approval_served_total++;
+	}
+
+	k_mutex_unlock(&session_mutex);
+
+	return approved;
+}
+
+void session_approval_end_all(void)
+{
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(sessions); i++) {
+		approval_end(&sessions[i]);
+	}
+
+	k_mutex_unlock(&session_mutex);
+}
+
+uint32_t session_approval_served_total(void)
+{
+	return approval_served_total;
+}
+
+int session_count(void)
+{
+	int count = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(sessions); i++) {
+		if (sessions[i].conn) {
+			count++;
+		}
+	}
+
+	return count;
+}
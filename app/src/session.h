@@ -0,0 +1,138 @@
+#ifndef SESSION_H_
+#define SESSION_H_
+
+#include "storage_manager.h"
+#include "msg_assembler.h"
+#include "request_parser.h"
+#include "latency.h"
+
+#include <zephyr.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+/**
+ * @brief Per-connection session
+ */
+struct session {
+	/** Connection of the client, NULL if the session is free */
+	struct bt_conn *conn;
+	/** Client address, used in the console prompts */
+	char addr[BT_ADDR_LE_STR_LEN];
+	/** Current security level of the connection */
+	bt_security_t sec_level;
+
+	/** Message being reassembled */
+	struct msg_assembler msg_rcv;
+	/** Cycle count at which the first fragment of the message was received */
+	uint32_t msg_start;
+
+	/** Pending request. The URL prefix of a search request is in pwd.url */
+	struct TRequest request;
+	/** Timestamps of the request, from its first fragment to the response */
+	struct latency_trace trace;
+	/** A request has been received and is waiting or being served */
+	bool busy;
+	/** The request is waiting to be served */
+	bool queued;
+
+	/** Uptime at which the approval session ends, 0 if there is none */
+	int64_t approval_until;
+	/** URL the approval session is limited to, empty for any URL */
+	char approval_url[URL_SIZE+1];
+	/** Requests served without confirmation during the approval session */
+	uint32_t approval_served;
+};
+
+/**
+ * @brief Open the session of a new connection
+ *
+ * @param conn New connection
+ *
+ * @return Session assigned to the connection, NULL if there is no free session
+ */
+struct session *session_open(struct bt_conn *conn);
+
+/**
+ * @brief Close the session of a connection. Any pending request is discarded
+ *
+ * @param conn Disconnected connection
+ */
+void session_close(struct bt_conn *conn);
+
+/**
+ * @brief Get the session of a connection
+ *
+ * @param conn Connection
+ *
+ * @return Session of the connection, NULL if there is none
+ */
+struct session *session_get(struct bt_conn *conn);
+
+/**
+ * @brief Queue the request of the session to be served. The request must have been filled in
+ *
+ * @param s Session
+ *
+ * @return 0 on success, -EBUSY if the session already has a request waiting or being served
+ */
+int session_submit(struct session *s);
+
+/**
+ * @brief Get the next session with a request waiting to be served
+ *
+ * Sessions are served in round-robin order so a client cannot starve the others.
+ *
+ * @return Session whose request must be served now, NULL if there is none
+ */
+struct session *session_next_pending(void);
+
+/**
+ * @brief Mark the request of the session as served and wipe it
+ *
+ * @param s Session
+ */
+void session_done(struct session *s);
+
+/**
+ * @brief Start an approval session: gets are served without confirmation for
+ *        CONFIG_BT_NUS_APPROVAL_SESSION_TIMEOUT seconds
+ *
+ * Only encrypted connections to a bonded peer can have an approval session. If
+ * CONFIG_BT_NUS_APPROVAL_SESSION_PER_URL is enabled, the session is limited to the given URL.
+ *
+ * @param s   Session
+ * @param url URL confirmed by the user, NULL if several URLs were confirmed at once
+ *
+ * @return 0 on success, -EPERM if the connection cannot have an approval session
+ */
+int session_approval_start(struct session *s, const char *url);
+
+/**
+ * @brief Check whether the request of the session can be served without confirmation.
+ *        Counts the request as served if so
+ *
+ * Only gets and batch gets are covered by an approval session. A batch get is only covered
+ * if the session is not limited to a URL. Searches always need confirmation.
+ *
+ * @param s Session
+ *
+ * @return true if the request is covered by an approval session
+ */
+bool session_approval_check(struct session *s);
+
+/**
+ * @brief End the approval sessions of every connection
+ */
+void session_approval_end_all(void);
+
+/**
+ * @brief Get the total number of requests served without confirmation
+ */
+uint32_t session_approval_served_total(void);
+
+/**
+ * @brief Get the number of open sessions
+ */
+int session_count(void);
+
+#endif /* SESSION_H_ */
@@ -1,4 +1,5 @@
 #include "storage_manager.h"
+#include "console_out.h"
 
 #include "errno.h"
 
@@ -13,6 +14,146 @@ struct flash_pages_info info;
 
 uint32_t numPwd;
 
+/* Slots of the password list sorted by URL and username, kept up to date on every store
+ * and delete so lookups are binary searches and listings come out in order
+ */
+static uint8_t pwdIndex[MAX_STORABLE_PWD];
+
+BUILD_ASSERT(MAX_STORABLE_PWD <= UINT8_MAX, "Password slots must fit the index");
+
+/* Fingerprint of the URL and username of every slot, so most lookups of passwords that
+ * are not stored are answered without reading the list from flash
+ */
+static uint16_t pwdFingerprint[MAX_STORABLE_PWD];
+
+static struct TLookupStats lookupStats;
+
+/* FNV-1a hash of the URL and username, folded to 16 bits */
+static uint16_t fingerprint(const char *url, const char *username){
+    uint32_t hash = 2166136261U;
+
+    for(const char *c = url; *c; c++){
+        hash = (hash ^ (uint8_t)*c) * 16777619U;
+    }
+    /* Separator, so that ("ab", "c") and ("a", "bc") differ */
+    hash = (hash ^ 0xFF) * 16777619U;
+    for(const char *c = username; *c; c++){
+        hash = (hash ^ (uint8_t)*c) * 16777619U;
+    }
+
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+static bool fingerprintMatch(uint16_t fp){
+    for(int i = 0; i < numPwd; i++){
+        if(pwdFingerprint[i] == fp){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int pwdCompare(const struct TPassword *pwd, const char *url, const char *username){
+    int cmp = strcmp(pwd->url, url);
+
+    return cmp ? cmp : strcmp(pwd->username, username);
+}
+
+/* Position in the index of the first password not lower than (url, username) */
+static int indexLowerBound(const struct TPassword *pwdList, const char *url, const char *username){
+    int low = 0;
+    int high = numPwd;
+
+    while(low < high){
+        int mid = (low + high) / 2;
+
+        if(pwdCompare(&pwdList[pwdIndex[mid]], url, username) < 0){
+            low = mid + 1;
+        }else{
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/* Position in the index of the given URL and username, -1 if not stored */
+static int indexFind(const struct TPassword *pwdList, const char *url, const char *username){
+    int pos = indexLowerBound(pwdList, url, username);
+
+    if(pos < numPwd && pwdCompare(&pwdList[pwdIndex[pos]], url, username) == 0){
+        return pos;
+    }
+
+    return -1;
+}
+
+static void indexInsert(const struct TPassword *pwdList, uint8_t slot){
+    int pos = indexLowerBound(pwdList, pwdList[slot].url, pwdList[slot].username);
+
+    memmove(&pwdIndex[pos + 1], &pwdIndex[pos], numPwd - pos);
+    pwdIndex[pos] = slot;
+}
+
+static bool slotValid(const struct TPassword *pwd){
+    return pwd->url[0] &&
+           memchr(pwd->url, '\0', sizeof(pwd->url)) &&
+           memchr(pwd->username, '\0', sizeof(pwd->username)) &&
+           memchr(pwd->pwd, '\0', sizeof(pwd->pwd));
+}
+
+/* Build the index of the stored passwords. Slots that cannot be read are dropped and the
+ * vault is rewritten without them, so the device keeps serving the others
+ */
+static void indexBuild(void){
+    int rc = 0;
+    uint32_t stored = numPwd;
+    uint32_t count = MIN(numPwd, MAX_STORABLE_PWD);
+    uint32_t valid = 0;
+    struct TPassword pwdList[MAX_STORABLE_PWD];
+
+    if(numPwd == 0){
+        return;
+    }
+
+    rc = nvs_read(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
+    if(rc < 0){
+        console_out_printf("Unable to read the password list (err = %d)\n", rc);
+        count = 0;
+    }else if(rc == 0){
+        /* An empty list holds no entries */
+        count = 0;
+    }else{
+        /* Only the entries that were written completely */
+        count = MIN(count, rc / sizeof(struct TPassword));
+    }
+
+    /* indexInsert() looks at the first numPwd entries of the index */
+    numPwd = 0;
+    for(uint32_t slot = 0; slot < count; slot++){
+        if(!slotValid(&pwdList[slot])){
+            continue;
+        }
+        if(valid != slot){
+            pwdList[valid] = pwdList[slot];
+        }
+        indexInsert(pwdList, valid);
+        pwdFingerprint[valid] = fingerprint(pwdList[valid].url, pwdList[valid].username);
+        numPwd = ++valid;
+    }
+
+    if(numPwd == stored){
+        return;
+    }
+
+    console_out_printf("Password list damaged. %u of %u passwords kept\n", numPwd, stored);
+    if(valid != count){
+        (void)nvs_write(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
+    }
+    (void)nvs_write(&fs, NUM_PWD_ID, &numPwd, sizeof(numPwd));
+}
+
 int store_manager_init(){
     int rc = 0;
     /* define the nvs file system by settings with:
@@ -22,13 +163,13 @@ int store_manager_init(){
 	 */
 	flash_dev = FLASH_AREA_DEVICE(STORAGE_NODE_LABEL);
 	if (!device_is_ready(flash_dev)) {
-		printk("Flash device %s is not ready\n", flash_dev->name);
+		console_out_printf("Flash device %s is not ready\n", flash_dev->name);
 		return INIT_ERROR;
 	}
 	fs.offset = FLASH_AREA_OFFSET(storage);
 	rc = flash_get_page_info_by_offs(flash_dev, fs.offset, &info);
 	if (rc) {
-		printk("Unable to get page info\n");
+		console_out_printf("Unable to get page info\n");
 		return INIT_ERROR;
 	}
 	fs.sector_size = info.size;
@@ -36,7 +177,7 @@ int store_manager_init(){
 
 	rc = nvs_init(&fs, flash_dev->name);
 	if (rc) {
-		printk("Flash Init failed\n");
+		console_out_printf("Flash Init failed\n");
 		return INIT_ERROR;
 	}
 
@@ -48,6 +189,8 @@ int store_manager_init(){
         (void)nvs_write(&fs, NUM_PWD_ID, &numPwd, sizeof(numPwd));
     }
 
+    indexBuild();
+
     return 0;
 }
 
@@ -55,26 +198,68 @@ int getPwd(struct TPassword *pwdStruct){
     int rc = 0;
     struct TPassword pwdList[MAX_STORABLE_PWD];
 
+    if(numPwd == 0){
+        /* Certainly not stored, but an empty vault may have no list yet: reading it gives
+         * the error getPwd() has always returned in that case
+         */
+        lookupStats.misses++;
+    }else if(!fingerprintMatch(fingerprint(pwdStruct->url, pwdStruct->username))){
+        /* Certainly not stored */
+        lookupStats.misses++;
+        return -1;
+    }
+
     rc = nvs_read(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
     if(rc > 0){
         /* List was found */
-        int i = 0;
-        while(i < numPwd){
-            if(strcmp(pwdStruct->url, pwdList[i].url) == 0 && strcmp(pwdStruct->username, pwdList[i].username) == 0){
-                strcpy(pwdStruct->pwd, pwdList[i].pwd);
-                return 0;
-            }else{
-                i++;
-            }
+        int pos = indexFind(pwdList, pwdStruct->url, pwdStruct->username);
+        if(pos >= 0){
+            strcpy(pwdStruct->pwd, pwdList[pwdIndex[pos]].pwd);
+            lookupStats.hits++;
+            return 0;
         }
         /* Password not found */
+        if(numPwd > 0){
+            lookupStats.falsePositives++;
+        }
         rc = -1;
     }else{
         strcpy(pwdStruct->pwd, "errno");
+        if(rc == 0){
+            /* An empty list holds no passwords */
+            rc = -1;
+        }
     }
     return rc;
 }
 
+bool pwdExists(const char *url, const char *username){
+    int rc = 0;
+    int pos = -1;
+    struct TPassword pwdList[MAX_STORABLE_PWD];
+
+    if(!fingerprintMatch(fingerprint(url, username))){
+        return false;
+    }
+
+    rc = nvs_read(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
+    if(rc > 0){
+        pos = indexFind(pwdList, url, username);
+    }
+    /* The list holds every password, do not leave it on the stack */
+    memset(pwdList, 0, sizeof(pwdList));
+
+    return pos >= 0;
+}
+
+int getNumPwd(){
+    return numPwd;
+}
+
+void getLookupStats(struct TLookupStats *stats){
+    *stats = lookupStats;
+}
+
 int getAllPwd(struct TPassword *pwdList){
     int rc = 0;
 
@@ -96,6 +281,62 @@ int getAllPwd(struct TPassword *pwdList){
     return 0;
 }
 
+int forEachPwdInRange(const char *fromUrl, const char *toUrl, pwd_visitor_t visitor, void *ctx){
+    int rc = 0;
+    int visited = 0;
+    struct TPassword pwdList[MAX_STORABLE_PWD];
+
+    if(numPwd == 0){
+        return 0;
+    }
+
+    rc = nvs_read(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
+    if(rc <= 0){
+        return rc;
+    }
+
+    /* Binary search for the start, then walk the index until the end of the range */
+    for(int pos = fromUrl ? indexLowerBound(pwdList, fromUrl, "") : 0; pos < numPwd; pos++){
+        const struct TPassword *pwd = &pwdList[pwdIndex[pos]];
+
+        if(toUrl && strcmp(pwd->url, toUrl) >= 0){
+            break;
+        }
+        visited++;
+        if(!visitor(pwd, ctx)){
+            break;
+        }
+    }
+
+    return visited;
+}
+
+int forEachPwd(const char *urlPrefix, pwd_visitor_t visitor, void *ctx){
+    size_t prefixLen = urlPrefix ? strlen(urlPrefix) : 0;
+    char toUrl[URL_SIZE+1];
+
+    if(prefixLen == 0){
+        return forEachPwdInRange(NULL, NULL, visitor, ctx);
+    }
+    if(prefixLen > URL_SIZE){
+        return 0;
+    }
+
+    /* The URLs starting with the prefix are those lower than the prefix with its last
+     * character incremented, unless that character cannot be incremented
+     */
+    strcpy(toUrl, urlPrefix);
+    while(prefixLen > 0 && (uint8_t)toUrl[prefixLen - 1] == UINT8_MAX){
+        toUrl[--prefixLen] = '\0';
+    }
+    if(prefixLen == 0){
+        return forEachPwdInRange(urlPrefix, NULL, visitor, ctx);
+    }
+    toUrl[prefixLen - 1]++;
+
+    return forEachPwdInRange(urlPrefix, toUrl, visitor, ctx);
+}
+
 int storePwd(const struct TPassword *pwdStruct){
     int rc = 0;
     struct TPassword pwdList[MAX_STORABLE_PWD];
@@ -103,29 +344,27 @@ int storePwd(const struct TPassword *pwdStruct){
     rc = nvs_read(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
     if(rc > 0 || numPwd == 0){
         /* List was found */
-        int i = 0;
-        while(i < numPwd){
-            if(strcmp(pwdStruct->url, pwdList[i].url) == 0 && strcmp(pwdStruct->username, pwdList[i].username) == 0){
-                /* Password previously stored. Update new password */
-                printk("Updating new password...\n");
-                strcpy(pwdList[i].pwd, pwdStruct->pwd);
-                (void)nvs_write(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
-
-                (void)nvs_write(&fs, NUM_PWD_ID, &numPwd, sizeof(numPwd));
-                return 0;
-            }else{
-                i++;
-            }
+        int pos = indexFind(pwdList, pwdStruct->url, pwdStruct->username);
+        if(pos >= 0){
+            /* Password previously stored. Update new password */
+            console_out_printf("Updating new password...\n");
+            strcpy(pwdList[pwdIndex[pos]].pwd, pwdStruct->pwd);
+            (void)nvs_write(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
+
+            (void)nvs_write(&fs, NUM_PWD_ID, &numPwd, sizeof(numPwd));
+            return 0;
         }
 
         /* Password not found. Store new password */
         if(numPwd < MAX_STORABLE_PWD || numPwd == 0){
-            printk("Storing new password...\n");
+            console_out_printf("Storing new password...\n");
             strcpy(pwdList[numPwd].url, pwdStruct->url);
             strcpy(pwdList[numPwd].username, pwdStruct->username);
             strcpy(pwdList[numPwd].pwd, pwdStruct->pwd);
             (void)nvs_write(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
 
+            indexInsert(pwdList, numPwd);
+            pwdFingerprint[numPwd] = fingerprint(pwdStruct->url, pwdStruct->username);
             numPwd++;
             (void)nvs_write(&fs, NUM_PWD_ID, &numPwd, sizeof(numPwd));
             return 0;
@@ -140,6 +379,44 @@ int storePwd(const struct TPassword *pwdStruct){
     return rc;
 }
 
+int deletePwd(const struct TPassword *pwdStruct){
+    int rc = 0;
+    int pos;
+    uint8_t slot;
+    uint8_t last;
+    struct TPassword pwdList[MAX_STORABLE_PWD];
+
+    rc = nvs_read(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
+    if(rc <= 0){
+        return rc;
+    }
+
+    pos = indexFind(pwdList, pwdStruct->url, pwdStruct->username);
+    if(pos < 0){
+        /* Password not found */
+        return -1;
+    }
+
+    /* Keep the list packed: the last password takes the freed slot */
+    slot = pwdIndex[pos];
+    last = numPwd - 1;
+    pwdList[slot] = pwdList[last];
+    pwdFingerprint[slot] = pwdFingerprint[last];
+    memset(&pwdList[last], 0, sizeof(pwdList[0]));
+    (void)nvs_write(&fs, PWD_LIST_ID, &pwdList, sizeof(pwdList));
+
+    memmove(&pwdIndex[pos], &pwdIndex[pos + 1], numPwd - pos - 1);
+    numPwd--;
+    for(int i = 0; i < numPwd; i++){
+        if(pwdIndex[i] == last){
+            pwdIndex[i] = slot;
+        }
+    }
+    (void)nvs_write(&fs, NUM_PWD_ID, &numPwd, sizeof(numPwd));
+
+    return 0;
+}
+
 void deleteAllPwd(){
     numPwd = 0;
 
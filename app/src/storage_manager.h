@@ -1,3 +1,6 @@
+#ifndef STORAGE_MANAGER_H_
+#define STORAGE_MANAGER_H_
+
 #include <zephyr.h>
 #include <sys/reboot.h>
 #include <device.h>
@@ -20,8 +23,20 @@ typedef struct TPassword{
 	char pwd[PWD_SIZE+1];
 };
 
+/* Outcome of the getPwd() lookups */
+struct TLookupStats{
+	/* Password found */
+	uint32_t hits;
+	/* Password not stored, answered from the RAM fingerprints without reading the flash */
+	uint32_t misses;
+	/* Password not stored, but its fingerprint matched a stored one so the list was read */
+	uint32_t falsePositives;
+};
+
 /**
  * @brief Initialize store manager
+ *
+ * A damaged password list does not make it fail: the passwords that can be read are kept.
 */
 int store_manager_init();
 
@@ -32,6 +47,27 @@ int store_manager_init();
 */
 int getPwd(struct TPassword *pwdStruct);
 
+/**
+ * @brief Check whether a password is stored for certain URL and username, without
+ * reading it out. Not counted in the lookup statistics
+ *
+ * @param url URL
+ * @param username Username
+*/
+bool pwdExists(const char *url, const char *username);
+
+/**
+ * @brief Get the number of stored passwords
+*/
+int getNumPwd();
+
+/**
+ * @brief Get the getPwd() lookup statistics
+ * 
+ * @param stats Filled with the statistics since boot
+*/
+void getLookupStats(struct TLookupStats *stats);
+
 /**
  * @brief Get all the stored password. Returns number of password stored
  * 
@@ -39,6 +75,32 @@ int getPwd(struct TPassword *pwdStruct);
 */
 int getAllPwd(struct TPassword *pwdList);
 
+/**
+ * @brief Callback called by forEachPwd for every matching password. Return false to stop
+ */
+typedef bool (*pwd_visitor_t)(const struct TPassword *pwdStruct, void *ctx);
+
+/**
+ * @brief Call visitor for the stored passwords whose URL is in [fromUrl, toUrl), in URL and
+ * username order. Returns number of passwords visited or negative error
+ *
+ * @param fromUrl First URL of the range, NULL to start with the lowest one
+ * @param toUrl URL following the range, NULL to end with the highest one
+ * @param visitor Callback called for every password in the range
+ * @param ctx Context passed to visitor
+*/
+int forEachPwdInRange(const char *fromUrl, const char *toUrl, pwd_visitor_t visitor, void *ctx);
+
+/**
+ * @brief Call visitor for the stored passwords whose URL starts with urlPrefix, in URL and
+ * username order. Returns number of passwords visited or negative error
+ *
+ * @param urlPrefix URL prefix to filter on, NULL or empty for all the passwords
+ * @param visitor Callback called for every matching password
+ * @param ctx Context passed to visitor
+*/
+int forEachPwd(const char *urlPrefix, pwd_visitor_t visitor, void *ctx);
+
 /**
  * @brief Store the given password assigned to the given URL and username
  * 
@@ -46,7 +108,16 @@ int getAllPwd(struct TPassword *pwdList);
 */
 int storePwd(const struct TPassword *pwdStruct);
 
+/**
+ * @brief Delete the password assigned to the given URL and username. Returns -1 if not found
+ * 
+ * @param pwdStruct Struct containing the URL and username of the password to be deleted
+*/
+int deletePwd(const struct TPassword *pwdStruct);
+
 /**
  * @brief Delete all stored passwords
 */
-void deleteAllPwd();
\ No newline at end of file
+void deleteAllPwd();
+
+#endif /* STORAGE_MANAGER_H_ */
@@ -10,6 +10,7 @@
 #include "uart_async_adapter.h"
 #include <drivers/uart.h>
 #include <sys/__assert.h>
+#include <string.h>
 
 #include <logging/log.h>
 LOG_MODULE_REGISTER(uart_async_adapter);
@@ -82,6 +83,7 @@ static inline void notify_rx_buffer(const struct device *dev)
 			event.data.rx.len = data->rx.curr_buf - data->rx.last_notify_buf;
 			event.data.rx.offset = data->rx.last_notify_buf - data->rx.buf;
 			data->rx.last_notify_buf = data->rx.curr_buf;
+			data->stats.rx_notifications++;
 			notify = true;
 		}
 	}
@@ -227,6 +229,15 @@ static int rx_enable(const struct device *dev, uint8_t *buf, size_t len, int32_t
 
 	k_spin_unlock(&(data->lock), key);
 
+#if CONFIG_BT_NUS_UART_ASYNC_ADAPTER_BATCHED
+	/* Start receiving into the buffer and ask for the next one straight away,
+	 * so that a buffer is always ready when the current one fills up
+	 */
+	if (!ret) {
+		switch_rx_buffer(dev, true);
+	}
+#endif
+
 	uart_irq_rx_enable(data->target);
 	uart_irq_err_enable(data->target);
 	return ret;
@@ -472,6 +483,7 @@ static inline void on_rx_ready(const struct device *dev, struct uart_async_adapt
 				}
 				cnt += ret;
 			} while (ret);
+			data->stats.rx_dropped += cnt;
 			LOG_ERR("Data received without buffer prepared, dropped %d bytes", cnt);
 		} else {
 			ret = uart_fifo_read(data->target, data->rx.curr_buf, data->rx.size_left);
@@ -481,6 +493,7 @@ static inline void on_rx_ready(const struct device *dev, struct uart_async_adapt
 				ret = 0;
 			}
 			__ASSERT_NO_MSG(data->rx.size_left >= ret);
+			data->stats.rx_bytes += ret;
 			data->rx.curr_buf += ret;
 			data->rx.size_left -= ret;
 			if (data->rx.timeout == 0) {
@@ -497,6 +510,118 @@ static inline void on_rx_ready(const struct device *dev, struct uart_async_adapt
 	LOG_DBG("%s: Exit", __func__);
 }
 
+#if CONFIG_BT_NUS_UART_ASYNC_ADAPTER_BATCHED
+
+#define RX_RING_SIZE CONFIG_BT_NUS_UART_ASYNC_ADAPTER_RING_SIZE
+#define RX_RING_MASK (RX_RING_SIZE - 1)
+
+BUILD_ASSERT((RX_RING_SIZE & RX_RING_MASK) == 0, "RX ring buffer size must be a power of two");
+
+/**
+ * @brief Move the data of the RX ring buffer into the user buffers
+ *
+ * Full buffers are notified and released. The data that does not fit because
+ * no buffer is available stays in the ring buffer.
+ *
+ * @param dev    UART device structure.
+ * @param notify Notify the data of the last, not full, buffer.
+ */
+static void rx_flush(const struct device *dev, bool notify)
+{
+	struct uart_async_adapter_data *data = access_dev_data(dev);
+
+	for (;;) {
+		k_spinlock_key_t key = k_spin_lock(&(data->lock));
+		uint32_t avail = data->rx_ring.head - data->rx_ring.tail;
+
+		if (!avail || !data->rx.enabled) {
+			k_spin_unlock(&(data->lock), key);
+			break;
+		}
+
+		if (!data->rx.size_left) {
+			k_spin_unlock(&(data->lock), key);
+
+			notify_rx_buffer(dev);
+			switch_rx_buffer(dev, true);
+
+			key = k_spin_lock(&(data->lock));
+			if (!data->rx.size_left) {
+				/* Keep the data until a buffer is provided */
+				k_spin_unlock(&(data->lock), key);
+				return;
+			}
+		}
+
+		uint32_t offset = data->rx_ring.tail & RX_RING_MASK;
+		size_t cnt = MIN(MIN(avail, RX_RING_SIZE - offset), data->rx.size_left);
+
+		memcpy(data->rx.curr_buf, &data->rx_ring.buf[offset], cnt);
+		data->rx.curr_buf += cnt;
+		data->rx.size_left -= cnt;
+		data->rx_ring.tail += cnt;
+
+		k_spin_unlock(&(data->lock), key);
+	}
+
+	if (notify) {
+		notify_rx_buffer(dev);
+	}
+}
+
+/**
+ * @brief Drain the FIFO into the RX ring buffer
+ *
+ * The user buffers are filled and notified in bulk: when the ring buffer is half
+ * full, or when the timeout set by the user expires after the first byte, instead
+ * of on every interrupt.
+ */
+static inline void on_rx_ready_batched(const struct device *dev,
+				       struct uart_async_adapter_data *data)
+{
+	int ret;
+	uint32_t used;
+
+	k_spinlock_key_t key = k_spin_lock(&(data->lock));
+
+	do {
+		uint32_t offset = data->rx_ring.head & RX_RING_MASK;
+		uint32_t space = RX_RING_SIZE - (data->rx_ring.head - data->rx_ring.tail);
+		uint8_t dummy;
+
+		if (space) {
+			ret = uart_fifo_read(data->target, &data->rx_ring.buf[offset],
+					     MIN(space, RX_RING_SIZE - offset));
+			if (ret > 0) {
+				data->rx_ring.head += ret;
+				data->stats.rx_bytes += ret;
+			}
+		} else {
+			/* Ring buffer full - dropping */
+			ret = uart_fifo_read(data->target, &dummy, 1);
+			if (ret > 0) {
+				data->stats.rx_dropped += ret;
+			}
+		}
+	} while (ret > 0);
+
+	used = data->rx_ring.head - data->rx_ring.tail;
+	data->stats.rx_ring_max = MAX(data->stats.rx_ring_max, used);
+
+	k_spin_unlock(&(data->lock), key);
+
+	if ((used >= RX_RING_SIZE / 2) || (data->rx.timeout == 0)) {
+		rx_flush(dev, true);
+	} else if (data->rx.timeout == SYS_FOREVER_MS) {
+		/* Only full buffers are notified */
+		rx_flush(dev, false);
+	} else if (!k_timer_remaining_ticks(&data->rx.timeout_timer)) {
+		k_timer_start(&data->rx.timeout_timer, SYS_TIMEOUT_MS(data->rx.timeout), K_NO_WAIT);
+	}
+}
+
+#endif /* CONFIG_BT_NUS_UART_ASYNC_ADAPTER_BATCHED */
+
 static inline void on_error(const struct device *dev,
 			    struct uart_async_adapter_data *data,
 			    int rx_err)
@@ -520,6 +645,7 @@ static void uart_irq_handler(const struct device *target_dev, void *context)
 	__ASSERT(target_dev == data->target,
 		"IRQ handler called with a context that seems uninitialized.");
 	LOG_DBG("irq_handler: Enter");
+	data->stats.irqs++;
 	if (uart_irq_update(target_dev) && uart_irq_is_pending(target_dev)) {
 		if (data->tx.enabled && uart_irq_tx_ready(target_dev)) {
 			on_tx_ready(dev, data);
@@ -528,7 +654,11 @@ static void uart_irq_handler(const struct device *target_dev, void *context)
 			on_tx_complete(dev, data);
 		}
 		if (data->rx.enabled && uart_irq_rx_ready(target_dev)) {
+#if CONFIG_BT_NUS_UART_ASYNC_ADAPTER_BATCHED
+			on_rx_ready_batched(dev, data);
+#else
 			on_rx_ready(dev, data);
+#endif
 		}
 
 		/* Check errors only after all the data is received from the device */
@@ -582,7 +712,11 @@ static void rx_timeout(struct k_timer *timer)
 {
 	const struct device *dev = k_timer_user_data_get(timer);
 
+#if CONFIG_BT_NUS_UART_ASYNC_ADAPTER_BATCHED
+	rx_flush(dev, true);
+#else
 	notify_rx_buffer(dev);
+#endif
 }
 
 void uart_async_adapter_init(const struct device *dev, const struct device *target)
@@ -604,3 +738,14 @@ void uart_async_adapter_init(const struct device *dev, const struct device *targ
 
 	dev->state->initialized = true;
 }
+
+void uart_async_adapter_stats_get(const struct device *dev, struct uart_async_adapter_stats *stats)
+{
+	struct uart_async_adapter_data *data = access_dev_data(dev);
+
+	k_spinlock_key_t key = k_spin_lock(&(data->lock));
+
+	*stats = data->stats;
+
+	k_spin_unlock(&(data->lock), key);
+}
@@ -24,6 +24,22 @@
 #include <zephyr.h>
 
 
+/**
+ * @brief UART asynch adapter statistics
+ */
+struct uart_async_adapter_stats {
+	/** Interrupts handled */
+	uint32_t irqs;
+	/** Bytes read from the UART FIFO */
+	uint32_t rx_bytes;
+	/** UART_RX_RDY notifications */
+	uint32_t rx_notifications;
+	/** Bytes dropped because no buffer was available */
+	uint32_t rx_dropped;
+	/** Highest number of bytes waiting in the RX ring buffer */
+	uint32_t rx_ring_max;
+};
+
 /**
  * @brief UART asynch adapter data structure
  *
@@ -76,6 +92,19 @@ struct uart_async_adapter_data {
 		/** RX state */
 		bool enabled;
 	} rx;
+
+#if CONFIG_BT_NUS_UART_ASYNC_ADAPTER_BATCHED
+	/** Ring buffer the FIFO is drained into from the interrupt */
+	struct {
+		uint8_t buf[CONFIG_BT_NUS_UART_ASYNC_ADAPTER_RING_SIZE];
+		/** Free running write and read positions */
+		uint32_t head;
+		uint32_t tail;
+	} rx_ring;
+#endif
+
+	/** Statistics */
+	struct uart_async_adapter_stats stats;
 };
 
 /**
@@ -123,4 +152,12 @@ extern const struct uart_driver_api uart_async_adapter_driver_api;
  */
 void uart_async_adapter_init(const struct device *dev, const struct device *target);
 
+/**
+ * @brief Get the adapter statistics
+ *
+ * @param dev   The adapter interface
+ * @param stats Statistics
+ */
+void uart_async_adapter_stats_get(const struct device *dev, struct uart_async_adapter_stats *stats);
+
 /** @} */
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2018 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Scripted central of the end-to-end benchmark
+ *
+ * Connects to the password manager running next to it in the simulation and
+ * replays the scenarios of test/test_script.js over the NUS service: GET on an
+ * empty storage, STORE, GET, batch GET and filling the storage with maximum size
+ * passwords. The peripheral is built with CONFIG_BT_NUS_TEST_AUTO_CONFIRM, so the
+ * scenarios rejected by the user are left out. Then every stored password is
+ * read back a few times.
+ *
+ * Requests are written in fragments of the same size as the web test. The
+ * latency of a request goes from its first fragment to the end of its last
+ * response. For every kind of request the latency percentiles and the throughput
+ * are printed as one JSON line. Times are simulated time.
+ */
+#include "nus_link.h"
+
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(CONFIG_ARCH_POSIX)
+#include <posix_board_if.h>
+#endif
+
+#define PEER_NAME "Hardware_Password_Manager"
+
+/* Same limits as test/test_script.js */
+#define MAX_PACKET_SIZE 61
+#define MAX_STORABLE_PWD 24
+#define LONG_URL "https://bluetooth_hardware_password_manager.com"
+#define LONG_USERNAME "username@bhpmtest.com"
+#define LONG_PWD "extremelylongpassword"
+
+#define TEST_URL "https://test.com"
+#define TEST_USER "user@test.com"
+#define TEST_PWD "1234567890A"
+
+/* Times every stored password is read back */
+#define GET_ROUNDS 4
+
+#define MSG_MAX NUS_LINK_MSG_MAX
+#define SAMPLES_MAX 128
+#define RESPONSE_TIMEOUT K_SECONDS(30)
+
+enum bench_kind {BENCH_GET, BENCH_STORE, BENCH_BATCH, BENCH_KIND_COUNT};
+
+static const char *const kind_names[] = {"get", "store", "batch"};
+
+struct bench_samples {
+	uint32_t us[SAMPLES_MAX];
+	int count;
+	uint32_t total_us;
+	uint32_t bytes;
+};
+
+static struct bench_samples samples[BENCH_KIND_COUNT];
+static int failures;
+
+static void sample_add(enum bench_kind kind, uint32_t us, uint32_t bytes)
+{
+	struct bench_samples *s = &samples[kind];
+
+	if (s->count < SAMPLES_MAX) {
+		s->us[s->count++] = us;
+	}
+	s->total_us += us;
+	s->bytes += bytes;
+}
+
+/*
+ * Send a request and check its responses against the expected ones. A batch
+ * request gets one response per entry followed by the final one
+ */
+static bool request(enum bench_kind kind, const char *msg, const char *const *expected,
+		    int expected_count)
+{
+	uint32_t bytes = nus_link_response_bytes();
+	int64_t start = k_uptime_ticks();
+	bool ok = true;
+
+	if (nus_link_send(msg, MAX_PACKET_SIZE)) {
+		failures++;
+		return false;
+	}
+
+	for (int i = 0; i < expected_count; i++) {
+		const char *response = nus_link_response_wait(RESPONSE_TIMEOUT);
+
+		if (!response) {
+			printk("No response to %s\n", msg);
+			failures++;
+			return false;
+		}
+
+		if (strcmp(response, expected[i])) {
+			printk("Request %s: expected %s, got %s\n", msg, expected[i], response);
+			ok = false;
+		}
+	}
+
+	sample_add(kind, (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks() - start),
+		   strlen(msg) + nus_link_response_bytes() - bytes);
+	if (!ok) {
+		failures++;
+	}
+
+	return ok;
+}
+
+static void scenario(const char *name, bool ok)
+{
+	printk("{\"scenario\":\"%s\",\"result\":\"%s\"}\n", name, ok ? "pass" : "fail");
+}
+
+static void scenarios_run(void)
+{
+	static const char *const rejected[] = {"{\"err\":\"operation rejected\"}"};
+	static const char *const ok[] = {"{\"err\":\"ok\"}"};
+	static const char *const full[] = {"{\"err\":\"storage is full\"}"};
+	/* The device answers a get with a space after the colon, unlike its other responses */
+	static const char *const pwd[] = {"{\"pwd\": \"" TEST_PWD "\"}"};
+	static const char *const batch[] = {
+		"{\"i\":0,\"pwd\":\"" TEST_PWD "\"}",
+		"{\"i\":1,\"err\":\"pwd not found\"}",
+		"{\"err\":\"ok\"}",
+	};
+	char msg[MSG_MAX];
+	char expected[MSG_MAX];
+	const char *expected_list[] = {expected};
+	int stored;
+	bool pass;
+
+	scenario("empty_storage",
+		 request(BENCH_GET, "{\"url\":\"" TEST_URL "\",\"user\":\"" TEST_USER "\"}",
+			 rejected, 1));
+	scenario("store_one",
+		 request(BENCH_STORE, "{\"url\":\"" TEST_URL "\",\"user\":\"" TEST_USER
+			 "\",\"pwd\":\"" TEST_PWD "\"}", ok, 1));
+	scenario("get_one",
+		 request(BENCH_GET, "{\"url\":\"" TEST_URL "\",\"user\":\"" TEST_USER "\"}",
+			 pwd, 1));
+	scenario("get_batch",
+		 request(BENCH_BATCH, "{\"batch\":[{\"url\":\"" TEST_URL "\",\"user\":\"" TEST_USER
+			 "\"},{\"url\":\"https://unknown.com\",\"user\":\"" TEST_USER "\"}]}",
+			 batch, ARRAY_SIZE(batch)));
+
+	/* Fill the storage with maximum size passwords, the first one is already stored */
+	for (stored = 1; stored < MAX_STORABLE_PWD; stored++) {
+		snprintf(msg, sizeof(msg), "{\"url\":\"%s\",\"user\":\"%d%s\",\"pwd\":\"%s%d\"}",
+			 LONG_URL, stored, LONG_USERNAME, LONG_PWD, stored);
+		if (!request(BENCH_STORE, msg, ok, 1)) {
+			break;
+		}
+	}
+	snprintf(msg, sizeof(msg), "{\"url\":\"%s\",\"user\":\"%d%s\",\"pwd\":\"%s%d\"}", LONG_URL,
+		 stored, LONG_USERNAME, LONG_PWD, stored);
+	pass = (stored == MAX_STORABLE_PWD) && request(BENCH_STORE, msg, full, 1);
+	scenario("fill_storage", pass);
+
+	/* Read every stored password back */
+	pass = true;
+	for (int round = 0; round < GET_ROUNDS; round++) {
+		for (int i = 1; i < stored; i++) {
+			snprintf(msg, sizeof(msg), "{\"url\":\"%s\",\"user\":\"%d%s\"}", LONG_URL, i,
+				 LONG_USERNAME);
+			snprintf(expected, sizeof(expected), "{\"pwd\": \"%s%d\"}", LONG_PWD, i);
+			pass &= request(BENCH_GET, msg, expected_list, 1);
+		}
+	}
+	scenario("get_all", pass);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const struct bench_samples *s, int p)
+{
+	return s->us[(s->count - 1) * p / 100];
+}
+
+static void report(void)
+{
+	for (int i = 0; i < BENCH_KIND_COUNT; i++) {
+		struct bench_samples *s = &samples[i];
+
+		if (!s->count || !s->total_us) {
+			continue;
+		}
+
+		qsort(s->us, s->count, sizeof(s->us[0]), compare_u32);
+
+		/* Requests are sent one after the other: throughput is bound by latency */
+		printk("{\"kind\":\"%s\",\"requests\":%d,\"p50_us\":%u,\"p90_us\":%u,"
+		       "\"p99_us\":%u,\"max_us\":%u,\"req_per_s\":%u,\"bytes_per_s\":%u}\n",
+		       kind_names[i], s->count, percentile(s, 50), percentile(s, 90),
+		       percentile(s, 99), s->us[s->count - 1],
+		       (uint32_t)((uint64_t)s->count * USEC_PER_SEC / s->total_us),
+		       (uint32_t)((uint64_t)s->bytes * USEC_PER_SEC / s->total_us));
+	}
+}
+
+void main(void)
+{
+	if (nus_link_connect(PEER_NAME, RESPONSE_TIMEOUT)) {
+		failures++;
+		goto end;
+	}
+	printk("Connected, MTU %u\n", nus_link_mtu());
+
+	scenarios_run();
+	report();
+
+end:
+	failures += nus_link_write_errors();
+	printk("%s: %d failures\n", failures ? "FAIL" : "PASS", failures);
+
+#if defined(CONFIG_ARCH_POSIX)
+	posix_exit(failures ? 1 : 0);
+#endif
+}
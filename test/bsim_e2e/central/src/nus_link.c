@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2018 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief NUS client connection to the password manager, shared by the simulated centrals
+ */
+#include "nus_link.h"
+
+#include <sys/printk.h>
+#include <string.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+#include <bluetooth/gatt_dm.h>
+#include <bluetooth/services/nus.h>
+#include <bluetooth/services/nus_client.h>
+
+#define RESPONSES_MAX 4
+
+static const char *peer;
+
+static struct bt_conn *default_conn;
+static struct bt_nus_client nus_client;
+
+static K_SEM_DEFINE(connected_sem, 0, 1);
+static K_SEM_DEFINE(ready_sem, 0, 1);
+static K_SEM_DEFINE(sent_sem, 0, 1);
+static K_SEM_DEFINE(response_sem, 0, RESPONSES_MAX);
+
+/* Response reassembly: a response is complete once its braces are balanced */
+static char rx_buf[NUS_LINK_MSG_MAX];
+static size_t rx_len;
+static int rx_depth;
+static bool rx_in_string;
+static bool rx_escape;
+
+static char responses[RESPONSES_MAX][NUS_LINK_MSG_MAX];
+static int responses_head;
+static int responses_tail;
+static uint32_t response_bytes;
+
+static uint32_t write_errors;
+
+static void response_complete(void)
+{
+	rx_buf[rx_len] = '\0';
+	strcpy(responses[responses_head % RESPONSES_MAX], rx_buf);
+	responses_head++;
+	response_bytes += rx_len;
+	rx_len = 0;
+	k_sem_give(&response_sem);
+}
+
+static uint8_t nus_received(struct bt_nus_client *nus, const uint8_t *data, uint16_t len)
+{
+	for (uint16_t i = 0; i < len; i++) {
+		char c = data[i];
+
+		if (rx_len == (sizeof(rx_buf) - 1)) {
+			printk("Response too long, discarded\n");
+			rx_len = 0;
+			rx_depth = 0;
+		}
+		rx_buf[rx_len++] = c;
+
+		if (rx_escape) {
+			rx_escape = false;
+		} else if (rx_in_string) {
+			rx_escape = (c == '\\');
+			rx_in_string = (c != '"');
+		} else if (c == '"') {
+			rx_in_string = true;
+		} else if (c == '{') {
+			rx_depth++;
+		} else if ((c == '}') && (--rx_depth == 0)) {
+			response_complete();
+		}
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void nus_sent(struct bt_nus_client *nus, uint8_t err, const uint8_t *const data,
+		     uint16_t len)
+{
+	if (err) {
+		printk("Write failed (err %u)\n", err);
+		write_errors++;
+	}
+	k_sem_give(&sent_sem);
+}
+
+static void discovery_complete(struct bt_gatt_dm *dm, void *context)
+{
+	struct bt_nus_client *nus = context;
+
+	bt_nus_handles_assign(dm, nus);
+	bt_nus_subscribe_receive(nus);
+	bt_gatt_dm_data_release(dm);
+
+	k_sem_give(&ready_sem);
+}
+
+static void discovery_service_not_found(struct bt_conn *conn, void *context)
+{
+	printk("NUS service not found\n");
+}
+
+static void discovery_error(struct bt_conn *conn, int err, void *context)
+{
+	printk("Discovery failed (err %d)\n", err);
+}
+
+static const struct bt_gatt_dm_cb discovery_cb = {
+	.completed = discovery_complete,
+	.service_not_found = discovery_service_not_found,
+	.error_found = discovery_error,
+};
+
+static void exchange_func(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+	if (err) {
+		printk("MTU exchange failed (err %u)\n", err);
+	}
+
+	err = bt_gatt_dm_start(conn, BT_UUID_NUS_SERVICE, &discovery_cb, &nus_client);
+	if (err) {
+		printk("Could not start discovery (err %d)\n", err);
+	}
+}
+
+static struct bt_gatt_exchange_params exchange_params = {
+	.func = exchange_func,
+};
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		printk("Connection failed (err %u)\n", err);
+		bt_conn_unref(default_conn);
+		default_conn = NULL;
+		return;
+	}
+
+	k_sem_give(&connected_sem);
+
+	err = bt_gatt_exchange_mtu(conn, &exchange_params);
+	if (err) {
+		printk("MTU exchange failed (err %d)\n", err);
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	printk("Disconnected (reason %u)\n", reason);
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+static bool ad_name_match(struct bt_data *data, void *user_data)
+{
+	bool *match = user_data;
+
+	if ((data->type == BT_DATA_NAME_COMPLETE) && (data->data_len == strlen(peer))) {
+		*match = !memcmp(data->data, peer, data->data_len);
+		return false;
+	}
+
+	return true;
+}
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+			 struct net_buf_simple *ad)
+{
+	bool match = false;
+	int err;
+
+	if (default_conn || ((type != BT_GAP_ADV_TYPE_ADV_IND) &&
+			     (type != BT_GAP_ADV_TYPE_ADV_DIRECT_IND))) {
+		return;
+	}
+
+	bt_data_parse(ad, ad_name_match, &match);
+	if (!match) {
+		return;
+	}
+
+	if (bt_le_scan_stop()) {
+		return;
+	}
+
+	err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, BT_LE_CONN_PARAM_DEFAULT,
+				&default_conn);
+	if (err) {
+		printk("Create connection failed (err %d)\n", err);
+		bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+	}
+}
+
+static struct bt_nus_client_init_param nus_init = {
+	.cb = {
+		.received = nus_received,
+		.sent = nus_sent,
+	},
+};
+
+int nus_link_connect(const char *peer_name, k_timeout_t timeout)
+{
+	int err;
+
+	peer = peer_name;
+
+	err = bt_nus_client_init(&nus_client, &nus_init);
+	if (!err) {
+		err = bt_enable(NULL);
+	}
+	if (!err) {
+		err = bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+	}
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return err;
+	}
+
+	if (k_sem_take(&connected_sem, timeout) || k_sem_take(&ready_sem, timeout)) {
+		printk("%s not found\n", peer_name);
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+int nus_link_send(const char *msg, size_t fragment)
+{
+	size_t len = strlen(msg);
+
+	for (size_t pos = 0; pos < len; pos += fragment) {
+		int err = bt_nus_client_send(&nus_client, (const uint8_t *)&msg[pos],
+					     MIN(len - pos, fragment));
+
+		if (err) {
+			printk("Send failed (err %d)\n", err);
+			return err;
+		}
+		k_sem_take(&sent_sem, K_FOREVER);
+	}
+
+	return 0;
+}
+
+const char *nus_link_response_wait(k_timeout_t timeout)
+{
+	if (k_sem_take(&response_sem, timeout)) {
+		return NULL;
+	}
+
+	return responses[responses_tail++ % RESPONSES_MAX];
+}
+
+uint32_t nus_link_response_bytes(void)
+{
+	return response_bytes;
+}
+
+uint32_t nus_link_write_errors(void)
+{
+	return write_errors;
+}
+
+uint16_t nus_link_mtu(void)
+{
+	return default_conn ? bt_gatt_get_mtu(default_conn) : 0;
+}
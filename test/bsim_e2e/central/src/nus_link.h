@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2018 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+#ifndef NUS_LINK_H_
+#define NUS_LINK_H_
+
+#include <zephyr.h>
+
+/* Longest response that can be reassembled */
+#define NUS_LINK_MSG_MAX 256
+
+/**
+ * @brief Connect to the password manager and subscribe to its NUS responses
+ *
+ * Scans for the device advertising the given name, connects, exchanges the MTU
+ * and discovers the NUS service.
+ *
+ * @param peer_name Advertised name of the device
+ * @param timeout   Time to wait for the connection to be ready
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int nus_link_connect(const char *peer_name, k_timeout_t timeout);
+
+/**
+ * @brief Write a request to the NUS RX characteristic, one fragment at a time
+ *
+ * @param msg      NUL terminated request
+ * @param fragment Maximum size of a fragment
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int nus_link_send(const char *msg, size_t fragment);
+
+/**
+ * @brief Wait for the next complete response
+ *
+ * Responses are complete once their braces are balanced. They stay valid until
+ * a few more responses have been received.
+ *
+ * @param timeout Time to wait
+ *
+ * @return NUL terminated response, NULL on timeout
+ */
+const char *nus_link_response_wait(k_timeout_t timeout);
+
+/**
+ * @brief Get the number of response bytes received so far
+ */
+uint32_t nus_link_response_bytes(void);
+
+/**
+ * @brief Get the number of writes that failed so far
+ */
+uint32_t nus_link_write_errors(void);
+
+/**
+ * @brief Get the ATT MTU of the connection
+ */
+uint16_t nus_link_mtu(void);
+
+#endif /* NUS_LINK_H_ */
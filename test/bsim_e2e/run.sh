@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+#
+# Copyright (c) 2018 Nordic Semiconductor
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Build the password manager and the scripted central for nrf52_bsim and run
+# them in the same BabbleSim simulation. Needs ZEPHYR_BASE, BSIM_OUT_PATH and
+# BSIM_COMPONENTS_PATH (see the BabbleSim setup of the Zephyr documentation)
+set -eu
+
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH is not set}"
+: "${BSIM_COMPONENTS_PATH:?BSIM_COMPONENTS_PATH is not set}"
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+APP="$HERE/../../app"
+BUILD="${BUILD_DIR:-$HERE/build}"
+SIM_ID="${SIM_ID:-bhpm_e2e}"
+# Simulated time limit in us
+SIM_LENGTH="${SIM_LENGTH:-600e6}"
+
+west build -b nrf52_bsim -d "$BUILD/peripheral" "$APP" -- \
+	-DOVERLAY_CONFIG="$HERE/peripheral.conf" \
+	-DDTC_OVERLAY_FILE="$HERE/nrf52_bsim.overlay"
+west build -b nrf52_bsim -d "$BUILD/central" "$HERE/central"
+
+cd "$BSIM_OUT_PATH/bin"
+
+"$BUILD/peripheral/zephyr/zephyr.exe" -s="$SIM_ID" -d=0 > "$BUILD/peripheral.log" 2>&1 &
+"$BUILD/central/zephyr/zephyr.exe" -s="$SIM_ID" -d=1 2>&1 | tee "$BUILD/central.log" &
+CENTRAL=$!
+./bs_2G4_phy_v1 -s="$SIM_ID" -D=2 -sim_length="$SIM_LENGTH" > /dev/null &
+
+wait $CENTRAL
+wait
+
+# The central prints PASS once every scenario has passed
+grep -q "^PASS" "$BUILD/central.log"
+grep '^{"kind"' "$BUILD/central.log" > "$BUILD/results.jsonl"
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2018 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Load generator client
+ *
+ * Connects to the password manager over NUS, stores its share of the vault and
+ * then sends CONFIG_LOADGEN_REQUESTS requests drawn from the configured mix, one
+ * at a time. Several clients can run against the same device: each one uses its
+ * own usernames, derived from its address.
+ *
+ * Every request is printed as one JSON line with its start time, latency and
+ * result, for test/loadgen/loadgen.py to aggregate. In the simulation the device
+ * confirms requests on its own (CONFIG_BT_NUS_TEST_AUTO_CONFIRM), on hardware
+ * they are confirmed by the user or served in an approval session.
+ */
+#include "nus_link.h"
+
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <bluetooth/bluetooth.h>
+
+#if defined(CONFIG_ARCH_POSIX)
+#include <posix_board_if.h>
+#endif
+
+#define PEER_NAME "Hardware_Password_Manager"
+
+#define URL_PREFIX "https://loadgen.test/"
+#define BATCH_ENTRIES 3
+
+#define MSG_MAX NUS_LINK_MSG_MAX
+#define CONNECT_TIMEOUT K_SECONDS(60)
+#define RESPONSE_TIMEOUT K_SECONDS(30)
+
+#define OWN_MAX 24
+#define OWN_COUNT MAX(1, CONFIG_LOADGEN_VAULT_SIZE / CONFIG_LOADGEN_CLIENTS)
+
+enum request_kind {KIND_GET, KIND_MISS, KIND_STORE, KIND_BATCH, KIND_SEARCH, KIND_COUNT};
+
+static const char *const kind_names[] = {"get", "miss", "store", "batch", "search"};
+
+static const int kind_weights[] = {
+	CONFIG_LOADGEN_MIX_GET,
+	CONFIG_LOADGEN_MIX_MISS,
+	CONFIG_LOADGEN_MIX_STORE,
+	CONFIG_LOADGEN_MIX_BATCH,
+	CONFIG_LOADGEN_MIX_SEARCH,
+};
+
+BUILD_ASSERT(ARRAY_SIZE(kind_names) == KIND_COUNT);
+BUILD_ASSERT(ARRAY_SIZE(kind_weights) == KIND_COUNT);
+BUILD_ASSERT(OWN_COUNT <= OWN_MAX);
+
+/* Result of a request: the expected response, or why not */
+enum request_result {RESULT_OK, RESULT_BUSY, RESULT_WRONG, RESULT_TIMEOUT, RESULT_SEND};
+
+static const char *const result_names[] = {"ok", "busy", "wrong", "timeout", "send"};
+
+/* Usernames of this client: <last 3 address bytes>-<index> */
+static char client[7];
+/* Current password of every password stored by this client */
+static char own_pwd[OWN_MAX][24];
+static uint32_t generation;
+static uint32_t rand_state;
+
+static uint32_t next_rand(void)
+{
+	/* xorshift32: reproducible for a given client address */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+static void client_init(void)
+{
+	bt_addr_le_t addr;
+	size_t count = 1;
+
+	bt_id_get(&addr, &count);
+	snprintf(client, sizeof(client), "%02x%02x%02x", addr.a.val[2], addr.a.val[1],
+		 addr.a.val[0]);
+	rand_state = sys_get_le32(addr.a.val) | 1;
+}
+
+static enum request_kind kind_draw(void)
+{
+	int total = 0;
+	int r;
+
+	for (int i = 0; i < KIND_COUNT; i++) {
+		total += kind_weights[i];
+	}
+
+	r = next_rand() % total;
+	for (int i = 0; i < KIND_COUNT; i++) {
+		if (r < kind_weights[i]) {
+			return i;
+		}
+		r -= kind_weights[i];
+	}
+
+	return KIND_GET;
+}
+
+/*
+ * Send a request and read its responses. A batch or search request ends with the
+ * response that has "err" without "i". expected is NULL when any content is fine
+ */
+static enum request_result request(const char *msg, const char *const *expected, int count,
+				   bool multi)
+{
+	enum request_result result = RESULT_OK;
+
+	if (nus_link_send(msg, CONFIG_LOADGEN_FRAGMENT_SIZE)) {
+		return RESULT_SEND;
+	}
+
+	for (int i = 0;; i++) {
+		const char *response = nus_link_response_wait(RESPONSE_TIMEOUT);
+
+		if (!response) {
+			return RESULT_TIMEOUT;
+		}
+
+		if (!strcmp(response, "{\"err\":\"busy\"}")) {
+			return RESULT_BUSY;
+		}
+
+		if (expected && ((i >= count) || strcmp(response, expected[i]))) {
+			result = RESULT_WRONG;
+		}
+
+		if (!multi || (strstr(response, "\"err\"") && !strstr(response, "\"i\""))) {
+			break;
+		}
+	}
+
+	return result;
+}
+
+static void store_msg(char *msg, int index)
+{
+	snprintf(own_pwd[index], sizeof(own_pwd[index]), "pwd%d.%u", index, generation++);
+	snprintf(msg, MSG_MAX, "{\"url\":\"" URL_PREFIX "%d\",\"user\":\"%s-%d\",\"pwd\":\"%s\"}",
+		 index, client, index, own_pwd[index]);
+}
+
+static enum request_result request_run(enum request_kind kind)
+{
+	static const char *const ok[] = {"{\"err\":\"ok\"}"};
+	static const char *const rejected[] = {"{\"err\":\"operation rejected\"}"};
+	static char expected[BATCH_ENTRIES + 1][MSG_MAX];
+	const char *expected_list[BATCH_ENTRIES + 1];
+	char msg[MSG_MAX];
+	int index = next_rand() % OWN_COUNT;
+	int len;
+
+	switch (kind) {
+	case KIND_GET:
+		snprintf(msg, sizeof(msg), "{\"url\":\"" URL_PREFIX "%d\",\"user\":\"%s-%d\"}",
+			 index, client, index);
+		/* The device answers a get with a space after the colon */
+		snprintf(expected[0], MSG_MAX, "{\"pwd\": \"%s\"}", own_pwd[index]);
+		expected_list[0] = expected[0];
+		return request(msg, expected_list, 1, false);
+
+	case KIND_MISS:
+		snprintf(msg, sizeof(msg), "{\"url\":\"" URL_PREFIX "%d\",\"user\":\"%s-none\"}",
+			 index, client);
+		return request(msg, rejected, 1, false);
+
+	case KIND_STORE:
+		store_msg(msg, index);
+		return request(msg, ok, 1, false);
+
+	case KIND_BATCH:
+		len = snprintf(msg, sizeof(msg), "{\"batch\":[");
+		for (int i = 0; i < BATCH_ENTRIES; i++) {
+			int entry = (index + i) % OWN_COUNT;
+
+			len += snprintf(&msg[len], sizeof(msg) - len,
+					"%s{\"url\":\"" URL_PREFIX "%d\",\"user\":\"%s-%d\"}",
+					i ? "," : "", entry, client, entry);
+			snprintf(expected[i], MSG_MAX, "{\"i\":%d,\"pwd\":\"%s\"}", i,
+				 own_pwd[entry]);
+			expected_list[i] = expected[i];
+		}
+		snprintf(&msg[len], sizeof(msg) - len, "]}");
+		expected_list[BATCH_ENTRIES] = ok[0];
+		return request(msg, expected_list, BATCH_ENTRIES + 1, true);
+
+	case KIND_SEARCH:
+	default:
+		/* The matches depend on the other clients */
+		return request("{\"search\":\"" URL_PREFIX "\"}", NULL, 0, true);
+	}
+}
+
+/* Store the share of the vault of this client */
+static int vault_fill(void)
+{
+	static const char *const ok[] = {"{\"err\":\"ok\"}"};
+	char msg[MSG_MAX];
+
+	for (int i = 0; i < OWN_COUNT; i++) {
+		enum request_result result;
+
+		store_msg(msg, i);
+		result = request(msg, ok, 1, false);
+		if (result != RESULT_OK) {
+			printk("Storing password %d failed: %s\n", i, result_names[result]);
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+void main(void)
+{
+	int errors = 0;
+
+	if (nus_link_connect(PEER_NAME, CONNECT_TIMEOUT)) {
+		errors++;
+		goto end;
+	}
+	client_init();
+
+	printk("{\"loadgen\":\"config\",\"client\":\"%s\",\"clients\":%d,\"vault\":%d,"
+	       "\"requests\":%d,\"think_ms\":%d,\"fragment\":%d,\"mtu\":%u}\n",
+	       client, CONFIG_LOADGEN_CLIENTS, OWN_COUNT * CONFIG_LOADGEN_CLIENTS,
+	       CONFIG_LOADGEN_REQUESTS, CONFIG_LOADGEN_THINK_TIME_MS,
+	       CONFIG_LOADGEN_FRAGMENT_SIZE, nus_link_mtu());
+
+	if (vault_fill()) {
+		errors++;
+		goto end;
+	}
+
+	for (int i = 0; i < CONFIG_LOADGEN_REQUESTS; i++) {
+		enum request_kind kind = kind_draw();
+		int64_t start = k_uptime_ticks();
+		enum request_result result = request_run(kind);
+
+		printk("{\"loadgen\":\"sample\",\"client\":\"%s\",\"kind\":\"%s\",\"t_us\":%u,"
+		       "\"us\":%u,\"result\":\"%s\"}\n",
+		       client, kind_names[kind], (uint32_t)k_ticks_to_us_floor64(start),
+		       (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks() - start),
+		       result_names[result]);
+
+		if ((result == RESULT_TIMEOUT) || (result == RESULT_SEND)) {
+			/* The link is gone, or out of sync with the responses */
+			errors++;
+			break;
+		}
+
+		if (CONFIG_LOADGEN_THINK_TIME_MS) {
+			k_sleep(K_MSEC(CONFIG_LOADGEN_THINK_TIME_MS));
+		}
+	}
+
+end:
+	printk("{\"loadgen\":\"done\",\"client\":\"%s\",\"errors\":%d}\n", client,
+	       errors + (int)nus_link_write_errors());
+
+#if defined(CONFIG_ARCH_POSIX)
+	posix_exit(0);
+#endif
+}
@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2018 Nordic Semiconductor
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Headless load generator for the password manager.
+
+Runs load generator clients (central/) against the device and aggregates the
+request samples they print into latency percentiles, throughput and error rates:
+
+  sim     build the app and the clients for nrf52_bsim and run them in BabbleSim
+  serial  read the clients running on development kits from their serial ports
+  report  aggregate the output of earlier runs
+
+The summary is printed as one JSON object per line: one per request kind and one
+for all requests together.
+"""
+
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import threading
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+APP = os.path.join(HERE, '..', '..', 'app')
+CENTRAL = os.path.join(HERE, 'central')
+PERIPHERAL_CONFS = [os.path.join(HERE, '..', 'bsim_e2e', 'peripheral.conf'),
+                    os.path.join(HERE, 'peripheral.conf')]
+DTC_OVERLAY = os.path.join(HERE, '..', 'bsim_e2e', 'nrf52_bsim.overlay')
+
+KINDS = ['get', 'miss', 'store', 'batch', 'search']
+DEFAULT_MIX = 'get=70,miss=5,store=10,batch=10,search=5'
+
+
+def parse_mix(text):
+    mix = {}
+    for item in text.split(','):
+        kind, _, weight = item.partition('=')
+        if kind not in KINDS or not weight.isdigit():
+            raise argparse.ArgumentTypeError(f'bad mix entry "{item}", kinds are {", ".join(KINDS)}')
+        mix[kind] = int(weight)
+    if not sum(mix.values()):
+        raise argparse.ArgumentTypeError('the mix weights add up to zero')
+    return {kind: mix.get(kind, 0) for kind in KINDS}
+
+
+def central_config(args):
+    """Kconfig options of the clients for the requested load"""
+    options = {
+        'LOADGEN_CLIENTS': args.clients,
+        'LOADGEN_VAULT_SIZE': args.vault,
+        'LOADGEN_REQUESTS': args.requests,
+        'LOADGEN_THINK_TIME_MS': args.think_ms,
+        'LOADGEN_FRAGMENT_SIZE': args.fragment,
+    }
+    options.update({f'LOADGEN_MIX_{kind.upper()}': weight for kind, weight in args.mix.items()})
+    return [f'-DCONFIG_{name}={value}' for name, value in options.items()]
+
+
+def build(args):
+    subprocess.run(['west', 'build', '-b', 'nrf52_bsim', '-d', os.path.join(args.build_dir, 'peripheral'),
+                    APP, '--', '-DOVERLAY_CONFIG=' + ';'.join(PERIPHERAL_CONFS),
+                    '-DDTC_OVERLAY_FILE=' + DTC_OVERLAY], check=True)
+    subprocess.run(['west', 'build', '-b', 'nrf52_bsim', '-d', os.path.join(args.build_dir, 'central'),
+                    CENTRAL, '--'] + central_config(args), check=True)
+
+
+def run_sim(args):
+    """Run the device and the clients in BabbleSim. Returns the output lines of the clients"""
+    bsim_bin = os.path.join(os.environ['BSIM_OUT_PATH'], 'bin')
+    peripheral_exe = os.path.join(args.build_dir, 'peripheral', 'zephyr', 'zephyr.exe')
+    central_exe = os.path.join(args.build_dir, 'central', 'zephyr', 'zephyr.exe')
+    sim_id = f'-s={args.sim_id}'
+
+    if not args.no_build:
+        build(args)
+
+    # Output to files: a client blocked on a full pipe would stall the whole simulation
+    logs = [open(os.path.join(args.build_dir, f'client{i}.log'), 'w+') for i in range(args.clients)]
+    with open(os.path.join(args.build_dir, 'peripheral.log'), 'w') as log:
+        peripheral = subprocess.Popen([peripheral_exe, sim_id, '-d=0'], cwd=bsim_bin,
+                                      stdout=log, stderr=subprocess.STDOUT)
+        clients = [subprocess.Popen([central_exe, sim_id, f'-d={i + 1}'], cwd=bsim_bin,
+                                    stdout=logs[i], stderr=subprocess.STDOUT)
+                   for i in range(args.clients)]
+        phy = subprocess.Popen(['./bs_2G4_phy_v1', sim_id, f'-D={args.clients + 1}',
+                                f'-sim_length={args.sim_length}'], cwd=bsim_bin,
+                               stdout=subprocess.DEVNULL)
+
+        for client in clients:
+            client.wait()
+
+        # The device never exits on its own
+        peripheral.kill()
+        phy.kill()
+        peripheral.wait()
+        phy.wait()
+
+    lines = []
+    for f in logs:
+        f.seek(0)
+        lines += f.read().splitlines()
+        f.close()
+
+    return lines
+
+
+def read_serial(args):
+    """Read the clients running on development kits until every one is done"""
+    import serial
+
+    lines = []
+    lock = threading.Lock()
+
+    def reader(port):
+        deadline = time.monotonic() + args.timeout
+        with serial.Serial(port, args.baudrate, timeout=1) as tty:
+            while time.monotonic() < deadline:
+                line = tty.readline().decode(errors='replace').strip()
+                with lock:
+                    lines.append(line)
+                if '"loadgen":"done"' in line:
+                    return
+        print(f'{port}: timed out', file=sys.stderr)
+
+    threads = [threading.Thread(target=reader, args=(port,)) for port in args.port]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    return lines
+
+
+def percentile(values, p):
+    """Nearest-rank percentile of sorted values"""
+    return values[max(0, math.ceil(p / 100 * len(values)) - 1)]
+
+
+def summarize(name, samples, window_us):
+    latencies = sorted(s['us'] for s in samples if s['result'] not in ('timeout', 'send'))
+    errors = {}
+    for s in samples:
+        if s['result'] != 'ok':
+            errors[s['result']] = errors.get(s['result'], 0) + 1
+
+    summary = {'loadgen': 'summary', 'kind': name, 'requests': len(samples),
+               'error_rate': round(sum(errors.values()) / len(samples), 4), 'errors': errors}
+    if latencies:
+        summary.update({'p50_us': percentile(latencies, 50), 'p90_us': percentile(latencies, 90),
+                        'p99_us': percentile(latencies, 99), 'max_us': latencies[-1]})
+    summary['req_per_s'] = round(len(samples) * 1e6 / window_us, 1) if window_us else 0
+    return summary
+
+
+def aggregate(lines, clients=None):
+    """Summaries of the sample lines, and the number of clients that failed or did not finish"""
+    samples = []
+    failed = 0
+    done = 0
+
+    for line in lines:
+        if not line.startswith('{"loadgen"'):
+            continue
+        record = json.loads(line)
+        if record['loadgen'] == 'sample':
+            samples.append(record)
+        elif record['loadgen'] == 'done':
+            done += 1
+            failed += record['errors'] > 0
+
+    if clients is not None:
+        failed += max(0, clients - done)
+    if not samples:
+        return [], max(failed, 1)
+
+    # Clients run at the same time: the throughput is over the whole run
+    window_us = max(s['t_us'] + s['us'] for s in samples) - min(s['t_us'] for s in samples)
+    summaries = [summarize(kind, [s for s in samples if s['kind'] == kind], window_us)
+                 for kind in KINDS if any(s['kind'] == kind for s in samples)]
+    summaries.append(summarize('all', samples, window_us))
+    summaries[-1]['clients'] = len({s['client'] for s in samples})
+
+    return summaries, failed + (done == 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--max-error-rate', type=float, default=0.0,
+                        help='fail if the overall error rate is higher (default %(default)s)')
+    parser.add_argument('--max-p99-us', type=int, help='fail if the overall p99 latency is higher')
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    sim = commands.add_parser('sim', help='run the device and the clients in BabbleSim')
+    sim.add_argument('--clients', type=int, default=2, choices=range(1, 5), help='concurrent clients')
+    sim.add_argument('--requests', type=int, default=200, help='requests per client')
+    sim.add_argument('--vault', type=int, default=12, choices=range(1, 25), metavar='1..24',
+                     help='passwords stored before the load, split between the clients')
+    sim.add_argument('--mix', type=parse_mix, default=parse_mix(DEFAULT_MIX),
+                     help=f'request weights (default {DEFAULT_MIX})')
+    sim.add_argument('--think-ms', type=int, default=0, help='time between a response and the next request')
+    sim.add_argument('--fragment', type=int, default=61, help='size of the request fragments')
+    sim.add_argument('--build-dir', default=os.path.join(HERE, 'build'))
+    sim.add_argument('--no-build', action='store_true', help='run the images already built')
+    sim.add_argument('--sim-id', default='bhpm_loadgen')
+    sim.add_argument('--sim-length', default='3600e6', help='simulated time limit in us')
+
+    ser = commands.add_parser('serial', help='read clients running on development kits')
+    ser.add_argument('--port', action='append', required=True, help='serial port of a client, repeatable')
+    ser.add_argument('--baudrate', type=int, default=115200)
+    ser.add_argument('--timeout', type=float, default=600, help='seconds to wait for the clients')
+
+    report = commands.add_parser('report', help='aggregate the output of earlier runs')
+    report.add_argument('logs', nargs='+', help='client output files')
+
+    args = parser.parse_args()
+
+    if args.command == 'sim':
+        if args.vault < args.clients:
+            parser.error('every client needs at least one password: --vault must be at least --clients')
+        os.makedirs(args.build_dir, exist_ok=True)
+        lines = run_sim(args)
+    elif args.command == 'serial':
+        lines = read_serial(args)
+    else:
+        lines = []
+        for log in args.logs:
+            with open(log) as f:
+                lines += f.read().splitlines()
+
+    summaries, failed = aggregate(lines, len(args.port) if args.command == 'serial' else
+                                  args.clients if args.command == 'sim' else None)
+    for summary in summaries:
+        print(json.dumps(summary, separators=(',', ':')))
+
+    overall = summaries[-1] if summaries else {}
+    if failed:
+        print(f'{failed} clients failed', file=sys.stderr)
+    if overall.get('error_rate', 1) > args.max_error_rate:
+        print(f'error rate {overall.get("error_rate")} over {args.max_error_rate}', file=sys.stderr)
+        failed += 1
+    if args.max_p99_us is not None and overall.get('p99_us', math.inf) > args.max_p99_us:
+        print(f'p99 latency {overall.get("p99_us")} us over {args.max_p99_us} us', file=sys.stderr)
+        failed += 1
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
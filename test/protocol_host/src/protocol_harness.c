@@ -0,0 +1,224 @@
+/** @file
+ *  @brief Reassembly and parsing of client requests with overflow and leak checks
+ */
+#include "protocol_harness.h"
+
+#include <cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CANARY 0x5a5aa5a5u
+
+static struct harness_heap_stats heap;
+
+/* The size of every allocation is kept in front of it */
+static void *tracked_malloc(size_t size)
+{
+	size_t *p = malloc(sizeof(size_t) + size);
+
+	if (!p) {
+		return NULL;
+	}
+
+	*p = size;
+	heap.outstanding++;
+	heap.allocs++;
+	heap.used += size;
+	if (heap.used > heap.max_used) {
+		heap.max_used = heap.used;
+	}
+
+	return &p[1];
+}
+
+static void tracked_free(void *ptr)
+{
+	size_t *p = ptr;
+
+	if (!p) {
+		return;
+	}
+
+	p--;
+	heap.outstanding--;
+	heap.used -= *p;
+	free(p);
+}
+
+void harness_heap_init(void)
+{
+	cJSON_Hooks hooks = {
+		.malloc_fn = tracked_malloc,
+		.free_fn = tracked_free,
+	};
+
+	cJSON_InitHooks(&hooks);
+}
+
+void harness_heap_stats_get(struct harness_heap_stats *stats)
+{
+	*stats = heap;
+}
+
+static void fail(const char *what, const char *msg)
+{
+	fprintf(stderr, "harness: %s\n", what);
+	if (msg) {
+		fprintf(stderr, "message: %s\n", msg);
+	}
+	abort();
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void harness_init(struct harness *h, harness_outcome_cb cb, void *ctx)
+{
+	memset(h, 0, sizeof(*h));
+	h->canary_head = CANARY;
+	h->canary_mid = CANARY;
+	h->canary_tail = CANARY;
+	h->cb = cb;
+	h->cb_ctx = ctx;
+	msg_assembler_reset(&h->msg_rcv);
+}
+
+static void check_canaries(const struct harness *h)
+{
+	if ((h->canary_head != CANARY) || (h->canary_mid != CANARY) ||
+	    (h->canary_tail != CANARY)) {
+		fail("buffer overflow", NULL);
+	}
+}
+
+static bool field_ok(const char *field, size_t max)
+{
+	return strnlen(field, max + 1) <= max;
+}
+
+static bool pwd_ok(const struct TPassword *p)
+{
+	return field_ok(p->url, URL_SIZE) && field_ok(p->username, USERNAME_SIZE) &&
+	       field_ok(p->pwd, PWD_SIZE);
+}
+
+/* Check a parsed request and describe it */
+static void request_describe(const struct TRequest *request, char *outcome)
+{
+	switch (request->type) {
+	case REQUEST_GET:
+		strcpy(outcome, "get");
+		break;
+	case REQUEST_STORE:
+		strcpy(outcome, "store");
+		break;
+	case REQUEST_SEARCH:
+		strcpy(outcome, "search");
+		break;
+	case REQUEST_GET_BATCH:
+		if ((request->batch.len < 1) || (request->batch.len > BATCH_MAX_SIZE)) {
+			fail("batch length out of range", NULL);
+		}
+		for (int i = 0; i < request->batch.len; i++) {
+			if (!pwd_ok(&request->batch.entries[i])) {
+				fail("batch entry field too long", NULL);
+			}
+		}
+		snprintf(outcome, HARNESS_OUTCOME_SIZE, "batch %d", request->batch.len);
+		break;
+	default:
+		fail("unknown request type", NULL);
+	}
+
+	if (!pwd_ok(&request->pwd)) {
+		fail("request field too long", NULL);
+	}
+}
+
+static void outcome(struct harness *h, const char *msg, size_t len, const char *what)
+{
+	if (h->cb) {
+		h->cb(msg, len, what, h->cb_ctx);
+	}
+}
+
+void harness_feed(struct harness *h, const uint8_t *data, size_t len)
+{
+	char result[HARNESS_OUTCOME_SIZE];
+	uint64_t start = 0;
+	int err;
+
+	h->stats.fragments++;
+
+	if (h->timing) {
+		start = now_ns();
+	}
+	err = msg_assembler_put(&h->msg_rcv, (const char *)data, len);
+	if (h->timing) {
+		h->stats.reassembly_ns += now_ns() - start;
+	}
+	check_canaries(h);
+
+	if ((h->msg_rcv.len >= sizeof(h->msg_rcv.buf)) || (h->msg_rcv.buf[h->msg_rcv.len] != '\0')) {
+		fail("message not terminated within its buffer", NULL);
+	}
+
+	if (err == -ENOMSG) {
+		h->stats.ignored++;
+		outcome(h, NULL, 0, "ignored");
+		return;
+	}
+
+	if (err == -EMSGSIZE) {
+		if (!msg_assembler_idle(&h->msg_rcv)) {
+			fail("message too long but not discarded", NULL);
+		}
+		h->stats.messages++;
+		h->stats.too_long++;
+		outcome(h, NULL, 0, "too_long");
+		return;
+	}
+
+	if (err == 0) {
+		/* More fragments needed */
+		return;
+	}
+
+	if ((err < 0) || ((size_t)err != h->msg_rcv.len)) {
+		fail("unexpected reassembly result", h->msg_rcv.buf);
+	}
+
+	h->stats.messages++;
+	if (h->timing) {
+		start = now_ns();
+	}
+	err = request_parse(h->msg_rcv.buf, &h->request);
+	if (h->timing) {
+		h->stats.parse_ns += now_ns() - start;
+	}
+	check_canaries(h);
+
+	if (heap.outstanding) {
+		fail("cJSON memory not freed", h->msg_rcv.buf);
+	}
+
+	if (err) {
+		h->stats.invalid++;
+		strcpy(result, "invalid");
+	} else {
+		request_describe(&h->request, result);
+	}
+
+	outcome(h, h->msg_rcv.buf, h->msg_rcv.len, result);
+
+	msg_assembler_reset(&h->msg_rcv);
+	memset(&h->request, 0, sizeof(h->request));
+}
@@ -0,0 +1,97 @@
+/*
+ * Host build of the BLE request path: reassembly and parsing of the fragments a
+ * client writes, with the checks shared by the replay and fuzz harnesses
+ */
+#ifndef PROTOCOL_HARNESS_H_
+#define PROTOCOL_HARNESS_H_
+
+#include "msg_assembler.h"
+#include "request_parser.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest fragment a client can write: ATT payload with a 247 byte MTU */
+#define HARNESS_FRAGMENT_MAX 244
+
+/* Long enough for "batch N" */
+#define HARNESS_OUTCOME_SIZE 16
+
+struct harness_stats {
+	uint32_t fragments;
+	/* Fragments discarded because they do not start a message */
+	uint32_t ignored;
+	/* Messages reassembled, parsed or not */
+	uint32_t messages;
+	uint32_t invalid;
+	uint32_t too_long;
+	/* Only measured when timing is enabled */
+	uint64_t reassembly_ns;
+	uint64_t parse_ns;
+};
+
+/**
+ * @brief Called for every outcome: a message parsed or rejected, or a fragment ignored
+ *
+ * @param msg     Reassembled message, NULL if the message was too long or the fragment ignored
+ * @param len     Length of the message
+ * @param outcome "get", "store", "batch N", "search", "invalid", "too_long" or "ignored"
+ * @param ctx     Context given to harness_init()
+ */
+typedef void (*harness_outcome_cb)(const char *msg, size_t len, const char *outcome, void *ctx);
+
+struct harness {
+	/* The canaries around the buffers catch overflows when built without ASan */
+	uint32_t canary_head;
+	struct msg_assembler msg_rcv;
+	uint32_t canary_mid;
+	struct TRequest request;
+	uint32_t canary_tail;
+
+	bool timing;
+	struct harness_stats stats;
+	harness_outcome_cb cb;
+	void *cb_ctx;
+};
+
+/**
+ * @brief Heap used through the cJSON hooks
+ */
+struct harness_heap_stats {
+	/* Allocations not freed yet */
+	uint32_t outstanding;
+	size_t used;
+	size_t max_used;
+	uint32_t allocs;
+};
+
+/**
+ * @brief Install the cJSON hooks tracking the heap. Call once before anything else
+ */
+void harness_heap_init(void);
+
+void harness_heap_stats_get(struct harness_heap_stats *stats);
+
+/**
+ * @brief Start a new connection: nothing received yet, statistics cleared
+ *
+ * @param h   Harness
+ * @param cb  Called for every outcome, may be NULL
+ * @param ctx Context of the callback
+ */
+void harness_init(struct harness *h, harness_outcome_cb cb, void *ctx);
+
+/**
+ * @brief Handle a fragment written by the client, as the BLE RX thread does
+ *
+ * Aborts if the message buffer overflowed, a parsed request has a field longer than
+ * allowed or cJSON memory is not freed once a message has been handled.
+ *
+ * @param h    Harness
+ * @param data Fragment
+ * @param len  Length of the fragment
+ */
+void harness_feed(struct harness *h, const uint8_t *data, size_t len);
+
+#endif /* PROTOCOL_HARNESS_H_ */
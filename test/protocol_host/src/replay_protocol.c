@@ -0,0 +1,264 @@
+/** @file
+ *  @brief Replay of captured client traces through reassembly and parsing
+ *
+ * A trace is a text file with one record per line:
+ *   w <hex>      fragment written by the client to the NUS RX characteristic
+ *   e <outcome>  expected outcome of the fragments written so far: get, store,
+ *                batch N, search, invalid, too_long or ignored
+ * Lines starting with '#' and empty lines are skipped.
+ *
+ * Every trace is replayed as captured and its outcomes checked. Then each of its
+ * messages is replayed again many times, split into random fragments of 1 to 244
+ * bytes, and must give the same outcome. One JSON object per line is printed per
+ * trace with the messages per second and the reassembly and parse times.
+ */
+#include "protocol_harness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ROUNDS 200
+#define TRACE_MESSAGES_MAX 256
+#define LINE_MAX_LEN (2 * MSG_RCV_BUFF_SIZE + 8)
+
+struct trace_message {
+	char *msg;
+	size_t len;
+	char outcome[HARNESS_OUTCOME_SIZE];
+};
+
+struct trace {
+	const char *name;
+	struct trace_message messages[TRACE_MESSAGES_MAX];
+	int count;
+	/* Outcomes checked against the expectations */
+	int checked;
+	int failures;
+};
+
+static int failures;
+
+static void trace_outcome(const char *msg, size_t len, const char *outcome, void *ctx)
+{
+	struct trace *t = ctx;
+	struct trace_message *m;
+
+	if (t->count == TRACE_MESSAGES_MAX) {
+		fprintf(stderr, "%s: more than %d outcomes\n", t->name, TRACE_MESSAGES_MAX);
+		exit(EXIT_FAILURE);
+	}
+
+	m = &t->messages[t->count++];
+	m->msg = msg ? strndup(msg, len) : NULL;
+	m->len = len;
+	strcpy(m->outcome, outcome);
+}
+
+static int hex_decode(const char *hex, uint8_t *out, size_t size)
+{
+	size_t len = 0;
+	unsigned int byte;
+
+	while ((hex[0] != '\0') && (hex[0] != '\n')) {
+		if ((len == size) || (sscanf(hex, "%2x", &byte) != 1)) {
+			return -1;
+		}
+		out[len++] = byte;
+		hex += 2;
+	}
+
+	return len;
+}
+
+/* Replay the trace as captured. Returns -1 if the file cannot be read */
+static int trace_replay(struct trace *t, const char *path)
+{
+	static struct harness h;
+	char line[LINE_MAX_LEN];
+	uint8_t fragment[HARNESS_FRAGMENT_MAX];
+	int lineno = 0;
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	harness_init(&h, trace_outcome, t);
+
+	while (fgets(line, sizeof(line), f)) {
+		char outcome[HARNESS_OUTCOME_SIZE + 1];
+		int len;
+
+		lineno++;
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if ((line[0] == '#') || (line[0] == '\0')) {
+			continue;
+		}
+
+		if (!strncmp(line, "w ", 2)) {
+			len = hex_decode(&line[2], fragment, sizeof(fragment));
+			if (len < 0) {
+				fprintf(stderr, "%s:%d: bad fragment\n", path, lineno);
+				t->failures++;
+				continue;
+			}
+			harness_feed(&h, fragment, len);
+		} else if (!strncmp(line, "e ", 2)) {
+			snprintf(outcome, sizeof(outcome), "%.*s", HARNESS_OUTCOME_SIZE, &line[2]);
+			if (t->checked == t->count) {
+				fprintf(stderr, "%s:%d: expected %s, got nothing\n", path, lineno, outcome);
+				t->failures++;
+			} else if (strcmp(t->messages[t->checked++].outcome, outcome)) {
+				fprintf(stderr, "%s:%d: expected %s, got %s\n", path, lineno, outcome,
+					t->messages[t->checked - 1].outcome);
+				t->failures++;
+			}
+		} else {
+			fprintf(stderr, "%s:%d: unknown record\n", path, lineno);
+			t->failures++;
+		}
+	}
+
+	fclose(f);
+
+	if (t->checked != t->count) {
+		fprintf(stderr, "%s: %d outcomes without expectation, the first is %s\n", path,
+			t->count - t->checked, t->messages[t->checked].outcome);
+		t->failures++;
+	}
+
+	return 0;
+}
+
+struct rechunk_check {
+	const char *expected;
+	bool ok;
+};
+
+static void rechunk_outcome(const char *msg, size_t len, const char *outcome, void *ctx)
+{
+	struct rechunk_check *c = ctx;
+
+	c->ok &= (c->expected && !strcmp(outcome, c->expected));
+	c->expected = NULL;
+}
+
+/* Replay the messages of the trace in random fragments and report the throughput */
+static void trace_bench(struct trace *t, int rounds)
+{
+	static struct harness h;
+	struct rechunk_check check;
+	uint32_t messages = 0;
+	uint64_t bytes = 0;
+
+	harness_init(&h, rechunk_outcome, &check);
+	h.timing = true;
+
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < t->count; i++) {
+			const struct trace_message *m = &t->messages[i];
+
+			if (!m->msg) {
+				/* Fragment ignored or message too long: nothing to rechunk */
+				continue;
+			}
+
+			check.expected = m->outcome;
+			check.ok = true;
+
+			for (size_t pos = 0; pos < m->len;) {
+				size_t len = 1 + rand() % HARNESS_FRAGMENT_MAX;
+
+				len = (len < m->len - pos) ? len : m->len - pos;
+				harness_feed(&h, (const uint8_t *)&m->msg[pos], len);
+				pos += len;
+			}
+
+			if (!check.ok || check.expected) {
+				fprintf(stderr, "%s: %s: rechunked message did not give %s\n", t->name,
+					m->msg, m->outcome);
+				t->failures++;
+				return;
+			}
+
+			messages++;
+			bytes += m->len;
+		}
+	}
+
+	uint64_t ns = h.stats.reassembly_ns + h.stats.parse_ns;
+	double msgs = messages ? messages : 1;
+	struct harness_heap_stats heap;
+
+	harness_heap_stats_get(&heap);
+
+	printf("{\"bench\":\"protocol\",\"trace\":\"%s\",\"messages\":%u,\"fragments\":%u,"
+	       "\"msgs_per_sec\":%.0f,\"mb_per_sec\":%.1f,\"reassembly_ns_per_msg\":%.0f,"
+	       "\"parse_ns_per_msg\":%.0f,\"heap_max_used\":%zu,\"failures\":%d}\n",
+	       t->name, messages, h.stats.fragments, ns ? messages * 1e9 / ns : 0.0,
+	       ns ? bytes * 1e3 / ns : 0.0, h.stats.reassembly_ns / msgs,
+	       h.stats.parse_ns / msgs, heap.max_used, t->failures);
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = ROUNDS;
+	unsigned int seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r rounds] [-s seed] trace...\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "usage: %s [-r rounds] [-s seed] trace...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	harness_heap_init();
+	srand(seed);
+
+	for (int i = optind; i < argc; i++) {
+		static struct trace t;
+		const char *name = strrchr(argv[i], '/');
+
+		memset(&t, 0, sizeof(t));
+		t.name = name ? name + 1 : argv[i];
+
+		if (trace_replay(&t, argv[i])) {
+			failures++;
+			continue;
+		}
+
+		if (!t.failures) {
+			trace_bench(&t, rounds);
+		}
+		failures += t.failures;
+
+		for (int m = 0; m < t.count; m++) {
+			free(t.messages[m].msg);
+		}
+	}
+
+	if (failures) {
+		fprintf(stderr, "%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
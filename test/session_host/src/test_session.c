@@ -0,0 +1,231 @@
+/** @file
+ *  @brief Unit tests of the sessions against fake connections and bonds
+ */
+#include "session.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures;
+
+#define CHECK(cond)                                                                  \
+	do {                                                                         \
+		if (!(cond)) {                                                       \
+			fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__,  \
+				__LINE__, __func__, #cond);                          \
+			failures++;                                                  \
+		}                                                                    \
+	} while (0)
+
+#define PER_URL IS_ENABLED(CONFIG_BT_NUS_APPROVAL_SESSION_PER_URL)
+
+struct bt_conn {
+	uint8_t index;
+	int refs;
+	bt_security_t sec_level;
+	bt_addr_le_t addr;
+};
+
+static struct bt_conn conns[CONFIG_BT_MAX_CONN] = {
+	{.index = 0, .addr = {.a = {1}}},
+	{.index = 1, .addr = {.a = {2}}},
+};
+
+static bt_addr_le_t bonds[CONFIG_BT_MAX_CONN];
+static int bond_count;
+
+static int64_t uptime;
+
+int64_t k_uptime_get(void)
+{
+	return uptime;
+}
+
+uint8_t bt_conn_index(struct bt_conn *conn)
+{
+	return conn->index;
+}
+
+struct bt_conn *bt_conn_ref(struct bt_conn *conn)
+{
+	conn->refs++;
+	return conn;
+}
+
+void bt_conn_unref(struct bt_conn *conn)
+{
+	conn->refs--;
+}
+
+bt_security_t bt_conn_get_security(struct bt_conn *conn)
+{
+	return conn->sec_level;
+}
+
+const bt_addr_le_t *bt_conn_get_dst(const struct bt_conn *conn)
+{
+	return &conn->addr;
+}
+
+int bt_addr_le_to_str(const bt_addr_le_t *addr, char *str, size_t len)
+{
+	return snprintf(str, len, "peer %u", addr->a[0]);
+}
+
+void bt_foreach_bond(uint8_t id, void (*func)(const struct bt_bond_info *info, void *user_data),
+		     void *user_data)
+{
+	for (int i = 0; i < bond_count; i++) {
+		struct bt_bond_info info = {.addr = bonds[i]};
+
+		func(&info, user_data);
+	}
+}
+
+/* Connect a client, bonded and encrypted if requested */
+static struct session *connect(struct bt_conn *conn, bool bonded)
+{
+	conn->sec_level = bonded ? BT_SECURITY_L2 : BT_SECURITY_L1;
+	if (bonded) {
+		bonds[bond_count++] = conn->addr;
+	}
+
+	return session_open(conn);
+}
+
+static void disconnect_all(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(conns); i++) {
+		session_close(&conns[i]);
+		CHECK(conns[i].refs == 0);
+	}
+	bond_count = 0;
+	uptime = 0;
+}
+
+static void request(struct session *s, enum REQUEST_TYPE type, const char *url)
+{
+	memset(&s->request, 0, sizeof(s->request));
+	s->request.type = type;
+	strcpy(s->request.pwd.url, url);
+}
+
+static void test_round_robin(void)
+{
+	struct session *a = connect(&conns[0], false);
+	struct session *b = connect(&conns[1], false);
+
+	CHECK(a && b);
+	CHECK(session_open(&conns[0]) == NULL);
+	CHECK(session_get(&conns[1]) == b);
+	CHECK(session_count() == 2);
+
+	CHECK(session_next_pending() == NULL);
+	CHECK(session_submit(a) == 0);
+	CHECK(session_submit(a) == -EBUSY);
+	CHECK(session_submit(b) == 0);
+
+	/* Served in turn from the session after the last one served, the first one at boot */
+	CHECK(session_next_pending() == b);
+	session_done(b);
+	CHECK(session_submit(b) == 0);
+	/* a has been waiting longer than the new request of b */
+	CHECK(session_next_pending() == a);
+	CHECK(session_next_pending() == b);
+	CHECK(session_next_pending() == NULL);
+
+	disconnect_all();
+	CHECK(session_count() == 0);
+}
+
+static void test_not_bonded(void)
+{
+	struct session *s = connect(&conns[0], false);
+
+	CHECK(session_approval_start(s, "a.com") == -EPERM);
+	request(s, REQUEST_GET, "a.com");
+	CHECK(!session_approval_check(s));
+
+	disconnect_all();
+}
+
+static void test_approved_requests(void)
+{
+	struct session *s = connect(&conns[0], true);
+	uint32_t served = session_approval_served_total();
+
+	request(s, REQUEST_GET, "a.com");
+	CHECK(!session_approval_check(s));
+
+	CHECK(session_approval_start(s, "a.com") == 0);
+	CHECK(session_approval_check(s));
+
+	request(s, REQUEST_GET, "b.com");
+	CHECK(session_approval_check(s) == !PER_URL);
+
+	request(s, REQUEST_GET_BATCH, "");
+	CHECK(session_approval_check(s) == !PER_URL);
+
+	/* Disclosing the stored URLs and usernames was never approved */
+	request(s, REQUEST_SEARCH, "a");
+	CHECK(!session_approval_check(s));
+	request(s, REQUEST_SEARCH, "a.com");
+	CHECK(!session_approval_check(s));
+
+	request(s, REQUEST_STORE, "a.com");
+	CHECK(!session_approval_check(s));
+
+	CHECK(session_approval_served_total() - served == (PER_URL ? 1 : 3));
+
+	disconnect_all();
+}
+
+static void test_timeout(void)
+{
+	struct session *s = connect(&conns[0], true);
+
+	CHECK(session_approval_start(s, "a.com") == 0);
+	request(s, REQUEST_GET, "a.com");
+
+	uptime = CONFIG_BT_NUS_APPROVAL_SESSION_TIMEOUT * MSEC_PER_SEC - 1;
+	CHECK(session_approval_check(s));
+	uptime++;
+	CHECK(!session_approval_check(s));
+
+	disconnect_all();
+}
+
+static void test_end(void)
+{
+	struct session *s = connect(&conns[0], true);
+
+	CHECK(session_approval_start(s, "a.com") == 0);
+	session_approval_end_all();
+	request(s, REQUEST_GET, "a.com");
+	CHECK(!session_approval_check(s));
+
+	CHECK(session_approval_start(s, "a.com") == 0);
+	session_close(&conns[0]);
+	s = connect(&conns[0], false);
+	CHECK(!session_approval_check(s));
+
+	disconnect_all();
+}
+
+int main(void)
+{
+	test_round_robin();
+	test_not_bonded();
+	test_approved_requests();
+	test_timeout();
+	test_end();
+
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+
+	printf("All session tests passed\n");
+
+	return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef SHIM_BLUETOOTH_BLUETOOTH_H_
+#define SHIM_BLUETOOTH_BLUETOOTH_H_
+
+#include <zephyr.h>
+
+#define BT_ID_DEFAULT 0
+
+#define BT_ADDR_LE_STR_LEN 30
+
+typedef struct {
+	uint8_t type;
+	uint8_t a[6];
+} bt_addr_le_t;
+
+struct bt_bond_info {
+	bt_addr_le_t addr;
+};
+
+static inline int bt_addr_le_cmp(const bt_addr_le_t *a, const bt_addr_le_t *b)
+{
+	return memcmp(a, b, sizeof(*a));
+}
+
+/* Provided by the test */
+int bt_addr_le_to_str(const bt_addr_le_t *addr, char *str, size_t len);
+void bt_foreach_bond(uint8_t id, void (*func)(const struct bt_bond_info *info, void *user_data),
+		     void *user_data);
+
+#endif /* SHIM_BLUETOOTH_BLUETOOTH_H_ */
@@ -0,0 +1,23 @@
+#ifndef SHIM_BLUETOOTH_CONN_H_
+#define SHIM_BLUETOOTH_CONN_H_
+
+#include <bluetooth/bluetooth.h>
+
+typedef enum {
+	BT_SECURITY_L0,
+	BT_SECURITY_L1,
+	BT_SECURITY_L2,
+	BT_SECURITY_L3,
+	BT_SECURITY_L4,
+} bt_security_t;
+
+/* Provided by the test */
+struct bt_conn;
+
+uint8_t bt_conn_index(struct bt_conn *conn);
+struct bt_conn *bt_conn_ref(struct bt_conn *conn);
+void bt_conn_unref(struct bt_conn *conn);
+bt_security_t bt_conn_get_security(struct bt_conn *conn);
+const bt_addr_le_t *bt_conn_get_dst(const struct bt_conn *conn);
+
+#endif /* SHIM_BLUETOOTH_CONN_H_ */
@@ -0,0 +1,16 @@
+#ifndef SHIM_DRIVERS_FLASH_H_
+#define SHIM_DRIVERS_FLASH_H_
+
+#include <device.h>
+
+struct flash_pages_info {
+	long start_offset;
+	size_t size;
+	uint32_t index;
+};
+
+/* Pages of the simulated flash, see nvs_sim.c */
+int flash_get_page_info_by_offs(const struct device *dev, long offset,
+				struct flash_pages_info *info);
+
+#endif /* SHIM_DRIVERS_FLASH_H_ */
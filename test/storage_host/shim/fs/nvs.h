@@ -0,0 +1,17 @@
+#ifndef SHIM_FS_NVS_H_
+#define SHIM_FS_NVS_H_
+
+#include <zephyr.h>
+#include <sys/types.h>
+
+struct nvs_fs {
+	long offset;
+	uint16_t sector_size;
+	uint16_t sector_count;
+};
+
+int nvs_init(struct nvs_fs *fs, const char *dev_name);
+ssize_t nvs_write(struct nvs_fs *fs, uint16_t id, const void *data, size_t len);
+ssize_t nvs_read(struct nvs_fs *fs, uint16_t id, void *data, size_t len);
+
+#endif /* SHIM_FS_NVS_H_ */
@@ -0,0 +1,11 @@
+#ifndef SHIM_STORAGE_FLASH_MAP_H_
+#define SHIM_STORAGE_FLASH_MAP_H_
+
+#include <device.h>
+
+extern const struct device nvs_sim_flash;
+
+#define FLASH_AREA_DEVICE(label) (&nvs_sim_flash)
+#define FLASH_AREA_OFFSET(label) 0
+
+#endif /* SHIM_STORAGE_FLASH_MAP_H_ */
@@ -0,0 +1,4 @@
+#ifndef SHIM_SYS_REBOOT_H_
+#define SHIM_SYS_REBOOT_H_
+
+#endif /* SHIM_SYS_REBOOT_H_ */
@@ -0,0 +1,61 @@
+/*
+ * Host build of the application modules: the subset of the Zephyr API they use
+ */
+#ifndef SHIM_ZEPHYR_H_
+#define SHIM_ZEPHYR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+#define BUILD_ASSERT(expr, msg) _Static_assert(expr, msg)
+
+#define __printf_like(f, a) __attribute__((format(printf, f, a)))
+
+#define BIT(n) (1UL << (n))
+
+/* Same expansion as the Zephyr macro: 1 if the option is defined to 1, 0 otherwise */
+#define IS_ENABLED(config_macro) Z_IS_ENABLED1(config_macro)
+#define Z_IS_ENABLED1(config_macro) Z_IS_ENABLED2(_XXXX##config_macro)
+#define _XXXX1 _YYYY,
+#define Z_IS_ENABLED2(one_or_two_args) Z_IS_ENABLED3(one_or_two_args 1, 0)
+#define Z_IS_ENABLED3(ignore_this, val, ...) val
+
+#define MSEC_PER_SEC 1000
+
+/* The host builds are single threaded */
+typedef int k_timeout_t;
+#define K_FOREVER (-1)
+
+struct k_mutex {
+	int locked;
+};
+
+#define K_MUTEX_DEFINE(name) struct k_mutex name
+
+static inline int k_mutex_lock(struct k_mutex *mutex, k_timeout_t timeout)
+{
+	mutex->locked++;
+	return 0;
+}
+
+static inline int k_mutex_unlock(struct k_mutex *mutex)
+{
+	mutex->locked--;
+	return 0;
+}
+
+/* Provided by the test, so it controls the time */
+int64_t k_uptime_get(void);
+
+#endif /* SHIM_ZEPHYR_H_ */
@@ -0,0 +1,206 @@
+/** @file
+ *  @brief Storage manager micro-benchmarks against the simulated NVS
+ *
+ * Runs store, update, get, list, prefix search, delete and clear workloads with the
+ * vault filled to several sizes. One JSON object per line is printed for every
+ * workload and size, with the operations per second and the flash cost per
+ * operation. The flash figures are deterministic and can be compared between
+ * releases; the times depend on the host.
+ */
+#include "storage_manager.h"
+#include "nvs_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Repetitions of the read-only workloads */
+#define ROUNDS 2000
+
+static const int vault_sizes[] = {1, 4, 8, 16, MAX_STORABLE_PWD};
+
+struct measure {
+	const char *workload;
+	int vault_size;
+	uint32_t ops;
+	uint64_t ns;
+	struct nvs_sim_stats flash;
+	/* Running sample */
+	struct timespec start;
+	struct nvs_sim_stats before;
+};
+
+static uint64_t timespec_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static void measure_begin(struct measure *m)
+{
+	nvs_sim_stats_get(&m->before);
+	clock_gettime(CLOCK_MONOTONIC, &m->start);
+}
+
+static void measure_end(struct measure *m, uint32_t ops)
+{
+	struct timespec end;
+	struct nvs_sim_stats after;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	nvs_sim_stats_get(&after);
+
+	m->ops += ops;
+	m->ns += timespec_ns(&end) - timespec_ns(&m->start);
+	m->flash.reads += after.reads - m->before.reads;
+	m->flash.bytes_read += after.bytes_read - m->before.bytes_read;
+	m->flash.writes += after.writes - m->before.writes;
+	m->flash.writes_skipped += after.writes_skipped - m->before.writes_skipped;
+	m->flash.bytes_programmed += after.bytes_programmed - m->before.bytes_programmed;
+	m->flash.erases += after.erases - m->before.erases;
+}
+
+static void measure_print(const struct measure *m)
+{
+	double ops = m->ops ? m->ops : 1;
+
+	printf("{\"bench\":\"storage_manager\",\"workload\":\"%s\",\"vault_size\":%d,"
+	       "\"ops\":%u,\"ops_per_sec\":%.0f,\"ns_per_op\":%.0f,"
+	       "\"bytes_read_per_op\":%.1f,\"writes_per_op\":%.2f,"
+	       "\"bytes_programmed_per_op\":%.1f,\"erases_per_op\":%.3f}\n",
+	       m->workload, m->vault_size, m->ops, m->ns ? m->ops * 1e9 / m->ns : 0.0,
+	       m->ns / ops, m->flash.bytes_read / ops, m->flash.writes / ops,
+	       m->flash.bytes_programmed / ops, m->flash.erases / ops);
+}
+
+/* Changes the passwords of every fill, so NVS never skips a write of unchanged data */
+static int generation;
+
+static struct TPassword bench_pwd(int i, const char *password)
+{
+	struct TPassword p = {0};
+
+	snprintf(p.url, sizeof(p.url), "site%03d.example.com", (i * 7919) % 1000);
+	snprintf(p.username, sizeof(p.username), "user%d", i);
+	snprintf(p.pwd, sizeof(p.pwd), "%s%d.%d", password, i, generation);
+
+	return p;
+}
+
+static void vault_fill(int size)
+{
+	generation++;
+	deleteAllPwd();
+	for (int i = 0; i < size; i++) {
+		struct TPassword p = bench_pwd(i, "pwd");
+
+		storePwd(&p);
+	}
+}
+
+static bool count_visit(const struct TPassword *p, void *ctx)
+{
+	(*(int *)ctx)++;
+
+	return true;
+}
+
+static void bench_size(int size)
+{
+	struct measure m;
+	int visited = 0;
+
+	/* Store new passwords into an empty vault */
+	m = (struct measure){.workload = "store", .vault_size = size};
+	generation++;
+	deleteAllPwd();
+	measure_begin(&m);
+	for (int i = 0; i < size; i++) {
+		struct TPassword p = bench_pwd(i, "pwd");
+
+		storePwd(&p);
+	}
+	measure_end(&m, size);
+	measure_print(&m);
+
+	/* Change every password */
+	m = (struct measure){.workload = "update", .vault_size = size};
+	measure_begin(&m);
+	for (int i = 0; i < size; i++) {
+		struct TPassword p = bench_pwd(i, "new");
+
+		storePwd(&p);
+	}
+	measure_end(&m, size);
+	measure_print(&m);
+
+	m = (struct measure){.workload = "get_hit", .vault_size = size};
+	measure_begin(&m);
+	for (int r = 0; r < ROUNDS; r++) {
+		struct TPassword p = bench_pwd(r % size, "");
+
+		getPwd(&p);
+	}
+	measure_end(&m, ROUNDS);
+	measure_print(&m);
+
+	m = (struct measure){.workload = "get_miss", .vault_size = size};
+	measure_begin(&m);
+	for (int r = 0; r < ROUNDS; r++) {
+		struct TPassword p = bench_pwd(MAX_STORABLE_PWD + r, "");
+
+		getPwd(&p);
+	}
+	measure_end(&m, ROUNDS);
+	measure_print(&m);
+
+	m = (struct measure){.workload = "list", .vault_size = size};
+	measure_begin(&m);
+	for (int r = 0; r < ROUNDS; r++) {
+		forEachPwd(NULL, count_visit, &visited);
+	}
+	measure_end(&m, ROUNDS);
+	measure_print(&m);
+
+	m = (struct measure){.workload = "prefix", .vault_size = size};
+	measure_begin(&m);
+	for (int r = 0; r < ROUNDS; r++) {
+		forEachPwd("site5", count_visit, &visited);
+	}
+	measure_end(&m, ROUNDS);
+	measure_print(&m);
+
+	m = (struct measure){.workload = "delete", .vault_size = size};
+	measure_begin(&m);
+	for (int i = 0; i < size; i++) {
+		struct TPassword p = bench_pwd(i, "");
+
+		deletePwd(&p);
+	}
+	measure_end(&m, size);
+	measure_print(&m);
+
+	/* Clear a full vault, refilled out of the measurement */
+	m = (struct measure){.workload = "clear", .vault_size = size};
+	for (int r = 0; r < 10; r++) {
+		vault_fill(size);
+		measure_begin(&m);
+		deleteAllPwd();
+		measure_end(&m, 1);
+	}
+	measure_print(&m);
+}
+
+int main(void)
+{
+	nvs_sim_erase();
+	if (store_manager_init()) {
+		fprintf(stderr, "Storage initialization failed\n");
+		return 1;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(vault_sizes); i++) {
+		bench_size(vault_sizes[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,24 @@
+/** @file
+ *  @brief Console output of the host build: discarded unless STORAGE_HOST_VERBOSE is set
+ */
+#include "console_out.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void console_out_printf(const char *fmt, ...)
+{
+	static int verbose = -1;
+	va_list args;
+
+	if (verbose < 0) {
+		verbose = (getenv("STORAGE_HOST_VERBOSE") != NULL);
+	}
+
+	if (verbose) {
+		va_start(args, fmt);
+		vfprintf(stderr, fmt, args);
+		va_end(args);
+	}
+}
@@ -0,0 +1,188 @@
+/** @file
+ *  @brief Simulated NVS
+ *
+ * Models the flash cost of the Zephyr NVS file system rather than its on-flash
+ * format. Every write appends the data, rounded up to the write block size, and an
+ * 8-byte allocation table entry (ATE) to the current sector; writes of unchanged
+ * data are skipped. When the current sector is full it is closed with an ATE and
+ * the next one is opened. The sector after it, the oldest one, is garbage collected
+ * into the new sector (its latest items are copied) and erased, so one sector is
+ * always empty, as NVS does.
+ */
+#include "nvs_sim.h"
+
+#include <fs/nvs.h>
+#include <drivers/flash.h>
+#include <storage/flash_map.h>
+
+/* nRF53 and nRF52 flash */
+#define SIM_PAGE_SIZE 4096
+#define SIM_WRITE_BLOCK_SIZE 4
+
+#define ATE_SIZE 8
+/* The close and garbage collection done ATEs of every sector */
+#define SECTOR_RESERVED (2 * ATE_SIZE)
+
+#define SIM_MAX_ID 16
+#define SIM_MAX_SECTORS 8
+
+const struct device nvs_sim_flash = {
+	.name = "nvs_sim_flash",
+};
+
+struct sim_item {
+	bool valid;
+	int sector;
+	size_t len;
+	uint8_t data[SIM_PAGE_SIZE];
+};
+
+static struct sim_item items[SIM_MAX_ID];
+static int read_errors[SIM_MAX_ID];
+static size_t sector_used[SIM_MAX_SECTORS];
+static int cur_sector;
+static int sector_count = 1;
+static size_t sector_size = SIM_PAGE_SIZE;
+
+static struct nvs_sim_stats stats;
+
+int flash_get_page_info_by_offs(const struct device *dev, long offset,
+				struct flash_pages_info *info)
+{
+	info->start_offset = offset - (offset % SIM_PAGE_SIZE);
+	info->size = SIM_PAGE_SIZE;
+	info->index = offset / SIM_PAGE_SIZE;
+
+	return 0;
+}
+
+void nvs_sim_erase(void)
+{
+	memset(items, 0, sizeof(items));
+	memset(read_errors, 0, sizeof(read_errors));
+	memset(sector_used, 0, sizeof(sector_used));
+	cur_sector = 0;
+}
+
+void nvs_sim_read_error(uint16_t id, int err)
+{
+	if (id < SIM_MAX_ID) {
+		read_errors[id] = err;
+	}
+}
+
+void nvs_sim_stats_get(struct nvs_sim_stats *out)
+{
+	*out = stats;
+}
+
+void nvs_sim_stats_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+static size_t item_cost(size_t len)
+{
+	return ((len + SIM_WRITE_BLOCK_SIZE - 1) / SIM_WRITE_BLOCK_SIZE) * SIM_WRITE_BLOCK_SIZE +
+	       ATE_SIZE;
+}
+
+static void sector_program(int sector, size_t len)
+{
+	sector_used[sector] += len;
+	stats.bytes_programmed += len;
+}
+
+/* Close the current sector, open the next one and garbage collect the oldest */
+static void sector_advance(void)
+{
+	int oldest;
+
+	sector_program(cur_sector, ATE_SIZE);
+
+	cur_sector = (cur_sector + 1) % sector_count;
+	oldest = (cur_sector + 1) % sector_count;
+
+	for (int id = 0; id < SIM_MAX_ID; id++) {
+		if (items[id].valid && items[id].sector == oldest) {
+			sector_program(cur_sector, item_cost(items[id].len));
+			items[id].sector = cur_sector;
+		}
+	}
+	sector_program(cur_sector, ATE_SIZE);
+
+	sector_used[oldest] = 0;
+	stats.erases++;
+}
+
+int nvs_init(struct nvs_fs *fs, const char *dev_name)
+{
+	if (fs->sector_count < 2 || fs->sector_count > SIM_MAX_SECTORS ||
+	    fs->sector_size != SIM_PAGE_SIZE) {
+		return -EINVAL;
+	}
+
+	sector_count = fs->sector_count;
+	sector_size = fs->sector_size;
+
+	return 0;
+}
+
+ssize_t nvs_write(struct nvs_fs *fs, uint16_t id, const void *data, size_t len)
+{
+	struct sim_item *item;
+	size_t cost = item_cost(len);
+
+	if (id >= SIM_MAX_ID || len > sizeof(item->data) || cost > sector_size - SECTOR_RESERVED) {
+		return -EINVAL;
+	}
+
+	item = &items[id];
+	if (item->valid && item->len == len && memcmp(item->data, data, len) == 0) {
+		stats.writes_skipped++;
+		return 0;
+	}
+
+	/* Garbage collection may fill the new sector, in which case the next one is used */
+	for (int i = 0; sector_used[cur_sector] + cost > sector_size - SECTOR_RESERVED; i++) {
+		if (i == sector_count) {
+			return -ENOSPC;
+		}
+		sector_advance();
+	}
+
+	sector_program(cur_sector, cost);
+	stats.writes++;
+
+	item->valid = true;
+	item->sector = cur_sector;
+	item->len = len;
+	memcpy(item->data, data, len);
+
+	return len;
+}
+
+ssize_t nvs_read(struct nvs_fs *fs, uint16_t id, void *data, size_t len)
+{
+	struct sim_item *item;
+
+	if (id >= SIM_MAX_ID) {
+		return -EINVAL;
+	}
+
+	if (read_errors[id]) {
+		return read_errors[id];
+	}
+
+	item = &items[id];
+	if (!item->valid) {
+		return -ENOENT;
+	}
+
+	len = MIN(len, item->len);
+	memcpy(data, item->data, len);
+	stats.reads++;
+	stats.bytes_read += len;
+
+	return item->len;
+}
@@ -0,0 +1,49 @@
+#ifndef NVS_SIM_H_
+#define NVS_SIM_H_
+
+#include <zephyr.h>
+
+/**
+ * @brief Flash operations done by the simulated NVS
+ */
+struct nvs_sim_stats {
+	/** nvs_read() calls */
+	uint32_t reads;
+	/** Bytes copied out by nvs_read() */
+	uint64_t bytes_read;
+	/** nvs_write() calls that programmed the flash */
+	uint32_t writes;
+	/** nvs_write() calls skipped because the data was unchanged */
+	uint32_t writes_skipped;
+	/** Bytes programmed, including allocation table entries and garbage collection */
+	uint64_t bytes_programmed;
+	/** Sectors erased */
+	uint32_t erases;
+};
+
+/**
+ * @brief Erase the whole simulated flash, as on a new device. The statistics are kept
+ */
+void nvs_sim_erase(void);
+
+/**
+ * @brief Make the reads of an item fail, as on a flash error
+ *
+ * @param id  Item
+ * @param err Negative error returned by nvs_read(), 0 to read the item again
+ */
+void nvs_sim_read_error(uint16_t id, int err);
+
+/**
+ * @brief Get the statistics since the last nvs_sim_stats_reset()
+ *
+ * @param stats Statistics
+ */
+void nvs_sim_stats_get(struct nvs_sim_stats *stats);
+
+/**
+ * @brief Reset the statistics
+ */
+void nvs_sim_stats_reset(void);
+
+#endif /* NVS_SIM_H_ */
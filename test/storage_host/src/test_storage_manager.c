@@ -0,0 +1,433 @@
+/** @file
+ *  @brief Unit tests of the storage manager against the simulated NVS
+ */
+#include "storage_manager.h"
+#include "nvs_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures;
+
+#define CHECK(cond)                                                                  \
+	do {                                                                         \
+		if (!(cond)) {                                                       \
+			fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__,  \
+				__LINE__, __func__, #cond);                          \
+			failures++;                                                  \
+		}                                                                    \
+	} while (0)
+
+static struct TPassword pwd(const char *url, const char *username, const char *password)
+{
+	struct TPassword p = {0};
+
+	strcpy(p.url, url);
+	strcpy(p.username, username);
+	strcpy(p.pwd, password);
+
+	return p;
+}
+
+/* New device */
+static void setup(void)
+{
+	nvs_sim_erase();
+	CHECK(store_manager_init() == 0);
+}
+
+struct visit_log {
+	int count;
+	char urls[MAX_STORABLE_PWD][URL_SIZE + 1];
+};
+
+static bool visit_log_add(const struct TPassword *p, void *ctx)
+{
+	struct visit_log *log = ctx;
+
+	strcpy(log->urls[log->count++], p->url);
+
+	return true;
+}
+
+static bool visit_stop(const struct TPassword *p, void *ctx)
+{
+	return false;
+}
+
+static void test_empty(void)
+{
+	struct TPassword p = pwd("a.com", "me", "");
+	struct visit_log log = {0};
+
+	setup();
+
+	CHECK(getNumPwd() == 0);
+	/* No list was ever written: the error of reading it */
+	CHECK(getPwd(&p) == -ENOENT);
+	CHECK(strcmp(p.pwd, "errno") == 0);
+	CHECK(forEachPwd(NULL, visit_log_add, &log) == 0);
+	CHECK(deletePwd(&p) != 0);
+}
+
+static void test_store_get_update(void)
+{
+	struct TPassword stored = pwd("a.com", "me", "secret");
+	struct TPassword p = pwd("a.com", "me", "");
+
+	setup();
+
+	CHECK(storePwd(&stored) == 0);
+	CHECK(getNumPwd() == 1);
+	CHECK(getPwd(&p) == 0);
+	CHECK(strcmp(p.pwd, "secret") == 0);
+
+	stored = pwd("a.com", "me", "other");
+	CHECK(storePwd(&stored) == 0);
+	CHECK(getNumPwd() == 1);
+	CHECK(getPwd(&p) == 0);
+	CHECK(strcmp(p.pwd, "other") == 0);
+
+	/* Same URL, other user */
+	p = pwd("a.com", "you", "");
+	CHECK(getPwd(&p) == -1);
+}
+
+static void test_full(void)
+{
+	struct TPassword p;
+
+	setup();
+
+	for (int i = 0; i < MAX_STORABLE_PWD; i++) {
+		char url[16];
+
+		snprintf(url, sizeof(url), "site%02d.com", i);
+		p = pwd(url, "me", "x");
+		CHECK(storePwd(&p) == 0);
+	}
+
+	p = pwd("extra.com", "me", "x");
+	CHECK(storePwd(&p) == -1);
+	CHECK(getNumPwd() == MAX_STORABLE_PWD);
+
+	/* Updates still work */
+	p = pwd("site00.com", "me", "y");
+	CHECK(storePwd(&p) == 0);
+}
+
+static void test_delete(void)
+{
+	struct TPassword p;
+
+	setup();
+
+	p = pwd("a.com", "me", "1");
+	storePwd(&p);
+	p = pwd("b.com", "me", "2");
+	storePwd(&p);
+	p = pwd("c.com", "me", "3");
+	storePwd(&p);
+
+	p = pwd("a.com", "me", "");
+	CHECK(deletePwd(&p) == 0);
+	CHECK(getNumPwd() == 2);
+	CHECK(getPwd(&p) == -1);
+	CHECK(deletePwd(&p) == -1);
+
+	/* The password moved to the freed slot is still found */
+	p = pwd("c.com", "me", "");
+	CHECK(getPwd(&p) == 0);
+	CHECK(strcmp(p.pwd, "3") == 0);
+
+	deleteAllPwd();
+	CHECK(getNumPwd() == 0);
+	p = pwd("b.com", "me", "");
+	CHECK(getPwd(&p) == -1);
+}
+
+static void test_sorted_prefix_range(void)
+{
+	const char *urls[] = {"mail.b.com", "bank.com", "mail.a.com", "zoo.org", "ma.net"};
+	struct visit_log log = {0};
+	struct TPassword p;
+
+	setup();
+
+	for (int i = 0; i < ARRAY_SIZE(urls); i++) {
+		p = pwd(urls[i], "me", "x");
+		storePwd(&p);
+	}
+
+	CHECK(forEachPwd(NULL, visit_log_add, &log) == ARRAY_SIZE(urls));
+	for (int i = 1; i < log.count; i++) {
+		CHECK(strcmp(log.urls[i - 1], log.urls[i]) < 0);
+	}
+
+	memset(&log, 0, sizeof(log));
+	CHECK(forEachPwd("mail.", visit_log_add, &log) == 2);
+	CHECK(strcmp(log.urls[0], "mail.a.com") == 0);
+	CHECK(strcmp(log.urls[1], "mail.b.com") == 0);
+
+	memset(&log, 0, sizeof(log));
+	CHECK(forEachPwdInRange("c", "n", visit_log_add, &log) == 3);
+	CHECK(strcmp(log.urls[0], "ma.net") == 0);
+
+	CHECK(forEachPwd("nothing", visit_log_add, &log) == 0);
+	CHECK(forEachPwd(NULL, visit_stop, NULL) == 1);
+}
+
+static void test_reboot(void)
+{
+	struct TPassword p;
+
+	setup();
+
+	p = pwd("b.com", "me", "2");
+	storePwd(&p);
+	p = pwd("a.com", "me", "1");
+	storePwd(&p);
+
+	/* The count and the index are rebuilt from the flash */
+	CHECK(store_manager_init() == 0);
+	CHECK(getNumPwd() == 2);
+	p = pwd("a.com", "me", "");
+	CHECK(getPwd(&p) == 0);
+	CHECK(strcmp(p.pwd, "1") == 0);
+}
+
+/* Items of the storage manager */
+#define NUM_PWD_ID 1
+#define PWD_LIST_ID 2
+
+static void test_empty_after_delete(void)
+{
+	struct TPassword p = pwd("a.com", "me", "1");
+
+	setup();
+
+	storePwd(&p);
+	CHECK(deletePwd(&p) == 0);
+	/* The list exists but holds nothing */
+	CHECK(getPwd(&p) == -1);
+}
+
+/* The list cannot be read at boot: the device comes up with an empty vault */
+static void test_list_read_error(void)
+{
+	struct TPassword p = pwd("a.com", "me", "1");
+
+	setup();
+
+	storePwd(&p);
+	nvs_sim_read_error(PWD_LIST_ID, -EIO);
+	CHECK(store_manager_init() == 0);
+	CHECK(getNumPwd() == 0);
+	nvs_sim_read_error(PWD_LIST_ID, 0);
+
+	/* The vault is usable again */
+	p = pwd("b.com", "me", "2");
+	CHECK(storePwd(&p) == 0);
+	CHECK(store_manager_init() == 0);
+	CHECK(getNumPwd() == 1);
+	p = pwd("b.com", "me", "");
+	CHECK(getPwd(&p) == 0);
+}
+
+/* The count says there are passwords but the list is empty: no entries */
+static void test_list_empty(void)
+{
+	struct nvs_fs fs = {0};
+	uint32_t count = 3;
+	struct TPassword p = pwd("a.com", "me", "");
+
+	setup();
+
+	CHECK(nvs_write(&fs, NUM_PWD_ID, &count, sizeof(count)) == sizeof(count));
+	CHECK(nvs_write(&fs, PWD_LIST_ID, NULL, 0) == 0);
+	CHECK(store_manager_init() == 0);
+	CHECK(getNumPwd() == 0);
+	CHECK(getPwd(&p) != 0);
+
+	/* The corrected count is stored */
+	CHECK(nvs_read(&fs, NUM_PWD_ID, &count, sizeof(count)) == sizeof(count));
+	CHECK(count == 0);
+}
+
+/* Slots that are not valid are dropped, the others are kept */
+static void test_list_damaged(void)
+{
+	struct nvs_fs fs = {0};
+	struct TPassword list[MAX_STORABLE_PWD] = {0};
+	uint32_t count = 4;
+	struct TPassword p;
+
+	setup();
+
+	list[0] = pwd("b.com", "me", "2");
+	memset(list[1].url, 'x', sizeof(list[1].url));
+	list[2] = pwd("a.com", "me", "1");
+	/* Slot 3 has no URL */
+	CHECK(nvs_write(&fs, PWD_LIST_ID, list, sizeof(list)) == sizeof(list));
+	CHECK(nvs_write(&fs, NUM_PWD_ID, &count, sizeof(count)) == sizeof(count));
+
+	CHECK(store_manager_init() == 0);
+	CHECK(getNumPwd() == 2);
+	p = pwd("a.com", "me", "");
+	CHECK(getPwd(&p) == 0);
+	CHECK(strcmp(p.pwd, "1") == 0);
+	p = pwd("b.com", "me", "");
+	CHECK(getPwd(&p) == 0);
+	CHECK(strcmp(p.pwd, "2") == 0);
+
+	/* The vault was rewritten without them */
+	CHECK(store_manager_init() == 0);
+	CHECK(getNumPwd() == 2);
+	p = pwd("c.com", "me", "3");
+	CHECK(storePwd(&p) == 0);
+	CHECK(getNumPwd() == 3);
+}
+
+static void test_miss_without_flash_read(void)
+{
+	struct TLookupStats before;
+	struct TLookupStats after;
+	struct nvs_sim_stats flash;
+	struct TPassword p;
+
+	setup();
+
+	p = pwd("a.com", "me", "1");
+	storePwd(&p);
+
+	getLookupStats(&before);
+	nvs_sim_stats_reset();
+
+	p = pwd("unknown.com", "me", "");
+	CHECK(getPwd(&p) == -1);
+
+	getLookupStats(&after);
+	nvs_sim_stats_get(&flash);
+	CHECK(after.misses + after.falsePositives == before.misses + before.falsePositives + 1);
+	if (after.misses > before.misses) {
+		CHECK(flash.reads == 0);
+	}
+}
+
+static void test_exists(void)
+{
+	struct TLookupStats before;
+	struct TLookupStats after;
+	struct TPassword p = pwd("a.com", "me", "1");
+
+	setup();
+
+	CHECK(!pwdExists("a.com", "me"));
+	storePwd(&p);
+
+	getLookupStats(&before);
+	CHECK(pwdExists("a.com", "me"));
+	CHECK(!pwdExists("a.com", "you"));
+	CHECK(!pwdExists("b.com", "me"));
+	getLookupStats(&after);
+	CHECK(memcmp(&before, &after, sizeof(before)) == 0);
+
+	deletePwd(&p);
+	CHECK(!pwdExists("a.com", "me"));
+}
+
+/* Random operations checked against a simple model of the vault */
+static void test_random(void)
+{
+	char model[MAX_STORABLE_PWD][URL_SIZE + USERNAME_SIZE + 2];
+	int model_len = 0;
+
+	setup();
+	srand(1);
+
+	for (int it = 0; it < 5000; it++) {
+		struct TPassword p = {0};
+		char key[sizeof(model[0])];
+		int found = -1;
+		int rc;
+
+		snprintf(p.url, sizeof(p.url), "%c%c.com", 'a' + rand() % 5, 'a' + rand() % 5);
+		snprintf(p.username, sizeof(p.username), "u%d", rand() % 3);
+		strcpy(p.pwd, "x");
+		snprintf(key, sizeof(key), "%s|%s", p.url, p.username);
+
+		for (int i = 0; i < model_len; i++) {
+			if (strcmp(model[i], key) == 0) {
+				found = i;
+			}
+		}
+
+		if (rand() % 3) {
+			rc = storePwd(&p);
+			if (found >= 0) {
+				CHECK(rc == 0);
+			} else if (model_len < MAX_STORABLE_PWD) {
+				CHECK(rc == 0);
+				strcpy(model[model_len++], key);
+			} else {
+				CHECK(rc == -1);
+			}
+		} else {
+			rc = deletePwd(&p);
+			CHECK((rc == 0) == (found >= 0));
+			if (found >= 0) {
+				memmove(model[found], model[--model_len], sizeof(model[0]));
+			}
+		}
+
+		CHECK(getNumPwd() == model_len);
+		/* Found after a successful store, gone after a delete */
+		if (rc == 0) {
+			bool stored = false;
+
+			for (int i = 0; i < model_len; i++) {
+				stored |= (strcmp(model[i], key) == 0);
+			}
+			CHECK((getPwd(&p) == 0) == stored);
+		}
+
+		if (it % 1000 == 0) {
+			CHECK(store_manager_init() == 0);
+		}
+	}
+
+	for (int i = 0; i < model_len; i++) {
+		struct TPassword p = {0};
+		char *sep = strchr(model[i], '|');
+
+		memcpy(p.url, model[i], sep - model[i]);
+		strcpy(p.username, sep + 1);
+		CHECK(getPwd(&p) == 0);
+	}
+}
+
+int main(void)
+{
+	test_empty();
+	test_store_get_update();
+	test_full();
+	test_delete();
+	test_sorted_prefix_range();
+	test_reboot();
+	test_empty_after_delete();
+	test_list_read_error();
+	test_list_empty();
+	test_list_damaged();
+	test_miss_without_flash_read();
+	test_exists();
+	test_random();
+
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+
+	printf("All storage manager tests passed\n");
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2018 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Password storage index benchmark
+ *
+ * The vault is filled to several sizes with passwords stored in random URL order.
+ * For every size, the average time of a lookup (hit and miss), of a linear scan of
+ * the same list, of a prefix search, of an insert and of a delete is reported.
+ */
+#include "storage_manager.h"
+
+#include <zephyr.h>
+#include <random/rand32.h>
+#include <sys/printk.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+static const int vault_sizes[] = {1, 8, 16, MAX_STORABLE_PWD};
+
+/* storage_manager.c reports through the console output module of the application */
+void console_out_printf(const char *fmt, ...)
+{
+}
+
+static struct TPassword vault[MAX_STORABLE_PWD];
+
+static void vault_fill(int size)
+{
+	deleteAllPwd();
+
+	for (int i = 0; i < size; i++) {
+		snprintf(vault[i].url, sizeof(vault[i].url), "%08x.example.com", sys_rand32_get());
+		snprintf(vault[i].username, sizeof(vault[i].username), "user%d", i);
+		snprintf(vault[i].pwd, sizeof(vault[i].pwd), "pwd%d", i);
+		storePwd(&vault[i]);
+	}
+}
+
+static uint32_t elapsed_ns(uint32_t start)
+{
+	return (uint32_t)k_cyc_to_ns_floor64(k_cycle_get_32() - start);
+}
+
+static bool count_visit(const struct TPassword *pwd, void *ctx)
+{
+	(*(int *)ctx)++;
+
+	return true;
+}
+
+/* Lookup without the index: compare every password of the list */
+static int linear_find(const struct TPassword *list, int len, const struct TPassword *key)
+{
+	for (int i = 0; i < len; i++) {
+		if (strcmp(key->url, list[i].url) == 0 &&
+		    strcmp(key->username, list[i].username) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void bench_size(int size)
+{
+	static struct TPassword list[MAX_STORABLE_PWD];
+	struct TPassword key;
+	uint64_t hit_ns = 0;
+	uint64_t scan_ns = 0;
+	uint32_t miss_ns;
+	uint32_t prefix_ns;
+	uint32_t insert_ns = 0;
+	uint32_t delete_ns;
+	uint32_t start;
+	int matches = 0;
+	char prefix[9];
+
+	vault_fill(size);
+	getAllPwd(list);
+
+	for (int i = 0; i < size; i++) {
+		key = vault[i];
+		start = k_cycle_get_32();
+		getPwd(&key);
+		hit_ns += elapsed_ns(start);
+
+		start = k_cycle_get_32();
+		(void)linear_find(list, size, &vault[i]);
+		scan_ns += elapsed_ns(start);
+	}
+
+	strcpy(key.url, "unknown.example.com");
+	strcpy(key.username, "nobody");
+	start = k_cycle_get_32();
+	getPwd(&key);
+	miss_ns = elapsed_ns(start);
+
+	/* The random part of the URL of the first password */
+	strncpy(prefix, vault[0].url, 8);
+	prefix[8] = '\0';
+	start = k_cycle_get_32();
+	forEachPwd(prefix, count_visit, &matches);
+	prefix_ns = elapsed_ns(start);
+
+	if (size < MAX_STORABLE_PWD) {
+		strcpy(key.url, "new.example.com");
+		strcpy(key.username, "new");
+		strcpy(key.pwd, "new");
+		start = k_cycle_get_32();
+		storePwd(&key);
+		insert_ns = elapsed_ns(start);
+	} else {
+		key = vault[size - 1];
+	}
+
+	start = k_cycle_get_32();
+	deletePwd(&key);
+	delete_ns = elapsed_ns(start);
+
+	printk("%d\t%u\t%u\t%u\t\t%u\t%u\t%u\t%d\n", size, (uint32_t)(hit_ns / size / 1000),
+	       miss_ns / 1000, (uint32_t)(scan_ns / size), prefix_ns / 1000, insert_ns / 1000,
+	       delete_ns / 1000, matches);
+}
+
+void main(void)
+{
+	if (store_manager_init()) {
+		printk("Storage initialization failed\n");
+		return;
+	}
+
+	printk("Password storage index benchmark\n");
+	printk("size\thit us\tmiss us\tscan ns\t\tprefix us\tinsert us\tdelete us\tmatches\n");
+
+	for (int i = 0; i < ARRAY_SIZE(vault_sizes); i++) {
+		bench_size(vault_sizes[i]);
+	}
+
+	deleteAllPwd();
+}
@@ -2,6 +2,10 @@ const deviceName = 'Hardware_Password_Manager'
 const bleService = '6E400001-B5A3-F393-E0A9-E50E24DCCA9E'.toLowerCase()
 const bleTxCharacteristic = '6E400003-B5A3-F393-E0A9-E50E24DCCA9E'.toLowerCase()
 const bleRxCharacteristic = '6E400002-B5A3-F393-E0A9-E50E24DCCA9E'.toLowerCase()
+const credService = '8a4c0001-6b3e-4a6f-9c1d-2f6e5a7b3c10'
+const credRequestCharacteristic = '8a4c0002-6b3e-4a6f-9c1d-2f6e5a7b3c10'
+const credResponseCharacteristic = '8a4c0003-6b3e-4a6f-9c1d-2f6e5a7b3c10'
+const credStatusCharacteristic = '8a4c0004-6b3e-4a6f-9c1d-2f6e5a7b3c10'
 
 const MAX_PACKET_SIZE = 61
 const MAX_STORABLE_PWD = 24
@@ -24,6 +28,8 @@ var storedPasswords = 0
 
 var deviceDetected
 var expectedResponse
+var batchResponses
+var rxBuffer = ''
 
 window.onload = function(){
     start_test_button = document.getElementById('start_test_button')
@@ -33,6 +39,10 @@ window.onload = function(){
         'Choose BHPM module inside WebBluetooth pop-up to connect to',
         'Connection and obtaining characteristics')
 
+    addTest(test_credentialServiceStatus,
+        '',
+        'Credential service status characteristic reports the device capabilities')
+
     addTest(test_emptyStorage,
         '',
         'Response to a GET password request must be an error if storage is empty')
@@ -53,6 +63,10 @@ window.onload = function(){
         'Type \'Y\' in the UART input',
         'GET password request success')
 
+    addTest(test_getBatchPwd,
+        'Type \'Y\' in the UART input',
+        'Batch GET password request success with a single confirmation')
+
     addTest(test_fillStore,
         'Type \'Y\' in the UART input until test finishes',
         'Exactly ' + MAX_STORABLE_PWD + " passwords () can be stored. Performed with maximum size passwords")        
@@ -123,7 +137,8 @@ function test_connect(){
         filters:[
             {name: deviceName,
             services: [bleService]}
-        ]
+        ],
+        optionalServices: [credService]
     }
 
     navigator.bluetooth.requestDevice(options)
@@ -152,6 +167,24 @@ function test_connect(){
         })
 }
 
+// Test that the status characteristic of the credential service can be read
+function test_credentialServiceStatus(){
+    deviceDetected.gatt.connect()
+    .then(server => server.getPrimaryService(credService))
+    .then(service => service.getCharacteristic(credStatusCharacteristic))
+    .then(characteristic => characteristic.readValue())
+    .then(value => {
+        const status = JSON.parse(new TextDecoder("utf-8").decode(value))
+        if(status['ver'] == 1 && status['url'] == URL_SIZE && status['user'] == USERNAME_SIZE
+            && status['pwd'] == PWD_SIZE && status['max'] == MAX_STORABLE_PWD) endTest(0)
+        else endTest(-1)
+    })
+    .catch(error => {
+        console.log("test_credentialServiceStatus error: " + error)
+        endTest(error)
+    })
+}
+
 // Test that response to a GET password request must be an error if storage is empty
 function test_emptyStorage(){
     expectedResponse = '{"err": "operation rejected"}'
@@ -244,6 +277,33 @@ function test_getOnePwd(){
     })
 }
 
+// Test batch GET password request success (one stored entry and one unknown entry)
+function test_getBatchPwd(){
+    expectedResponse = ['{"i": 0, "pwd": "1234567890A"}', '{"i": 1, "err": "pwd not found"}', '{"err": "ok"}']
+    batchResponses = new Array()
+    deviceDetected.gatt.connect()
+    .then(server => server.getPrimaryService(bleService))
+    .then(service => service.getCharacteristic(bleTxCharacteristic))
+    .then(characteristic => {
+        characteristic.removeEventListener('characteristicvaluechanged', wb_receiveNotification)
+        characteristic.addEventListener('characteristicvaluechanged', wb_receiveNotification_batch)
+        return deviceDetected.gatt.connect()
+    })
+    .then(server => server.getPrimaryService(bleService))
+    .then(service => service.getCharacteristic(bleRxCharacteristic))
+    .then(characteristic => {
+        let msg = JSON.stringify({batch: [
+            {url: "https://test.com", user: "user@test.com"},
+            {url: "https://unknown.com", user: "user@test.com"}
+        ]})
+        let packets = splitString(msg, MAX_PACKET_SIZE)
+        wb_sendPackets(characteristic, packets, 0)
+    })
+    .catch(error => {
+        console.log("test_getBatchPwd error: " + error)
+    })
+}
+
 // Test what happens when exactly 24 passwords can be stored (the first one was previously stored)
 function test_fillStore(){
     expectedResponse = '{"err": "ok"}'
@@ -297,7 +357,8 @@ function wb_receiveNotification(event){
     const valueReceived = event.target.value
     const value = encoder.decode(valueReceived)
 
-    const response = JSON.parse(value)
+    const response = wb_reassemble(value)
+    if(response == null) return
     const expected = JSON.parse(expectedResponse)
 
     if(expected.hasOwnProperty('err') && response.hasOwnProperty('err')
@@ -310,6 +371,31 @@ function wb_receiveNotification(event){
     else endTest(-1)
 }
 
+// Specific event listener used for batch GET password requests. Collects every response of the sequence
+function wb_receiveNotification_batch(event){
+    if(!("TextDecoder" in window)){
+        alert("This browser does not support TextDecoder")
+    }
+    var encoder = new TextDecoder("utf-8")
+    const valueReceived = event.target.value
+    const value = encoder.decode(valueReceived)
+
+    const response = wb_reassemble(value)
+    if(response == null) return
+    batchResponses.push(response)
+
+    if(!response.hasOwnProperty('err') || response.hasOwnProperty('i')) return
+
+    // Last message of the sequence. Restore the generic event listener
+    event.target.removeEventListener('characteristicvaluechanged', wb_receiveNotification_batch)
+    event.target.addEventListener('characteristicvaluechanged', wb_receiveNotification)
+
+    const expected = expectedResponse.map(r => JSON.parse(r))
+    if(expected.length == batchResponses.length
+        && expected.every((r, i) => JSON.stringify(r) == JSON.stringify(batchResponses[i]))) endTest(0)
+    else endTest(-1)
+}
+
 // Specific event listener used for storage 24 passwords
 function wb_receiveNotification_fillStore(event){
     if(!("TextDecoder" in window)){
@@ -319,7 +405,8 @@ function wb_receiveNotification_fillStore(event){
     const valueReceived = event.target.value
     const value = encoder.decode(valueReceived)
 
-    const response = JSON.parse(value)
+    const response = wb_reassemble(value)
+    if(response == null) return
     
     if(response.hasOwnProperty('err') && response['err'] == 'ok') {
         storedPasswords++
@@ -348,6 +435,19 @@ function wb_sendPackets(characteristic, packets, packetNumber){
     }
 }
 
+// Responses longer than one notification arrive in several fragments.
+// Returns the response once it is complete, null otherwise
+function wb_reassemble(value){
+    rxBuffer += value
+    try{
+        const response = JSON.parse(rxBuffer)
+        rxBuffer = ''
+        return response
+    }catch(e){
+        return null
+    }
+}
+
 function infoToJSON(url, user, pwd){
     if(pwd == null){
         return JSON.stringify({url: url, user: user})
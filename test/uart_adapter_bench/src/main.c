@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2018 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief UART async adapter benchmark
+ *
+ * The adapter is connected to a simulated interrupt driven UART with a 16 byte
+ * FIFO. The line is simulated at increasing baud rates: the RX interrupt is raised
+ * when the FIFO reaches its trigger level, and the bytes that arrive while the
+ * adapter interrupt handler runs (measured with the cycle counter) are added to
+ * the FIFO. A byte that arrives with a full FIFO is an overrun.
+ *
+ * For every baud rate, the interrupts and UART_RX_RDY notifications per KB, the
+ * interrupt handler time and the overruns are reported, followed by the maximum
+ * baud rate sustained without overruns.
+ */
+#include "uart_async_adapter.h"
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/uart.h>
+#include <sys/printk.h>
+#include <string.h>
+
+#define SIM_FIFO_SIZE 16
+/* RX interrupt raised when this number of bytes is waiting in the FIFO */
+#define SIM_FIFO_TRIGGER 8
+
+#define BENCH_BYTES 16384
+#define RX_BUF_SIZE 64
+#define RX_BUF_COUNT 3
+#define RX_TIMEOUT_MS 50
+
+static const uint32_t bauds[] = {
+	9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000, 2000000, 4000000,
+};
+
+/* Simulated UART */
+
+struct sim_uart_data {
+	uint8_t fifo[SIM_FIFO_SIZE];
+	int count;
+	bool rx_irq;
+	uint32_t overruns;
+	uart_irq_callback_user_data_t cb;
+	void *cb_data;
+};
+
+static struct sim_uart_data sim_data;
+
+static int sim_fifo_fill(const struct device *dev, const uint8_t *tx_data, int len)
+{
+	return len;
+}
+
+static int sim_fifo_read(const struct device *dev, uint8_t *rx_data, const int size)
+{
+	int cnt = MIN(size, sim_data.count);
+
+	memcpy(rx_data, sim_data.fifo, cnt);
+	memmove(sim_data.fifo, &sim_data.fifo[cnt], sim_data.count - cnt);
+	sim_data.count -= cnt;
+
+	return cnt;
+}
+
+static void sim_irq_tx_enable(const struct device *dev)
+{
+}
+
+static void sim_irq_tx_disable(const struct device *dev)
+{
+}
+
+static int sim_irq_tx_ready(const struct device *dev)
+{
+	return 0;
+}
+
+static int sim_irq_tx_complete(const struct device *dev)
+{
+	return 1;
+}
+
+static void sim_irq_rx_enable(const struct device *dev)
+{
+	sim_data.rx_irq = true;
+}
+
+static void sim_irq_rx_disable(const struct device *dev)
+{
+	sim_data.rx_irq = false;
+}
+
+static int sim_irq_rx_ready(const struct device *dev)
+{
+	return sim_data.count > 0;
+}
+
+static void sim_irq_err_enable(const struct device *dev)
+{
+}
+
+static void sim_irq_err_disable(const struct device *dev)
+{
+}
+
+static int sim_irq_is_pending(const struct device *dev)
+{
+	return sim_data.rx_irq && (sim_data.count > 0);
+}
+
+static int sim_irq_update(const struct device *dev)
+{
+	return 1;
+}
+
+static void sim_irq_callback_set(const struct device *dev, uart_irq_callback_user_data_t cb,
+				 void *user_data)
+{
+	sim_data.cb = cb;
+	sim_data.cb_data = user_data;
+}
+
+static int sim_err_check(const struct device *dev)
+{
+	return 0;
+}
+
+static int sim_poll_in(const struct device *dev, unsigned char *c)
+{
+	return -1;
+}
+
+static void sim_poll_out(const struct device *dev, unsigned char c)
+{
+}
+
+static const struct uart_driver_api sim_uart_api = {
+	.poll_in = sim_poll_in,
+	.poll_out = sim_poll_out,
+	.err_check = sim_err_check,
+	.fifo_fill = sim_fifo_fill,
+	.fifo_read = sim_fifo_read,
+	.irq_tx_enable = sim_irq_tx_enable,
+	.irq_tx_disable = sim_irq_tx_disable,
+	.irq_tx_ready = sim_irq_tx_ready,
+	.irq_rx_enable = sim_irq_rx_enable,
+	.irq_rx_disable = sim_irq_rx_disable,
+	.irq_tx_complete = sim_irq_tx_complete,
+	.irq_rx_ready = sim_irq_rx_ready,
+	.irq_err_enable = sim_irq_err_enable,
+	.irq_err_disable = sim_irq_err_disable,
+	.irq_is_pending = sim_irq_is_pending,
+	.irq_update = sim_irq_update,
+	.irq_callback_set = sim_irq_callback_set,
+};
+
+static int sim_uart_init(const struct device *dev)
+{
+	return 0;
+}
+
+DEVICE_DEFINE(sim_uart, "SIM_UART", sim_uart_init, NULL, &sim_data, NULL,
+	      POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE, &sim_uart_api);
+
+/* Byte arriving on the line */
+static void sim_rx_byte(uint8_t c)
+{
+	if (sim_data.count == SIM_FIFO_SIZE) {
+		sim_data.overruns++;
+		return;
+	}
+
+	sim_data.fifo[sim_data.count++] = c;
+}
+
+/* Run the interrupt handler. Returns the time it took in ns */
+static uint32_t sim_irq(const struct device *dev)
+{
+	uint32_t start = k_cycle_get_32();
+
+	sim_data.cb(dev, sim_data.cb_data);
+
+	return (uint32_t)k_cyc_to_ns_floor64(k_cycle_get_32() - start);
+}
+
+/* Adapter user */
+
+UART_ASYNC_ADAPTER_INST_DEFINE(async_adapter);
+
+static uint8_t rx_bufs[RX_BUF_COUNT][RX_BUF_SIZE];
+static int rx_buf_next;
+static uint32_t rx_received;
+
+static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	switch (evt->type) {
+	case UART_RX_RDY:
+		rx_received += evt->data.rx.len;
+		break;
+
+	case UART_RX_BUF_REQUEST:
+		uart_rx_buf_rsp(dev, rx_bufs[rx_buf_next], RX_BUF_SIZE);
+		rx_buf_next = (rx_buf_next + 1) % RX_BUF_COUNT;
+		break;
+
+	default:
+		break;
+	}
+}
+
+struct bench_result {
+	uint32_t irqs;
+	uint32_t notifications;
+	uint64_t isr_ns_total;
+	uint32_t isr_ns_max;
+	uint32_t overruns;
+	uint32_t dropped;
+	uint32_t received;
+};
+
+static void bench_run(const struct device *sim, uint32_t baud, struct bench_result *res)
+{
+	struct uart_async_adapter_stats before;
+	struct uart_async_adapter_stats after;
+	uint64_t byte_ns = 10ULL * NSEC_PER_SEC / baud;
+	uint64_t busy_until = 0;
+
+	memset(res, 0, sizeof(*res));
+	sim_data.overruns = 0;
+	sim_data.count = 0;
+	rx_received = 0;
+
+	uart_async_adapter_stats_get(async_adapter, &before);
+	uart_rx_enable(async_adapter, rx_bufs[rx_buf_next], RX_BUF_SIZE, RX_TIMEOUT_MS);
+	rx_buf_next = (rx_buf_next + 1) % RX_BUF_COUNT;
+
+	for (uint32_t i = 0; i < BENCH_BYTES; i++) {
+		uint64_t now = i * byte_ns;
+
+		sim_rx_byte((uint8_t)i);
+
+		/* The interrupt is only taken once the previous handler has returned */
+		if ((sim_data.count >= SIM_FIFO_TRIGGER) && (now >= busy_until)) {
+			uint32_t isr_ns = sim_irq(sim);
+
+			res->isr_ns_total += isr_ns;
+			res->isr_ns_max = MAX(res->isr_ns_max, isr_ns);
+			busy_until = now + isr_ns;
+		}
+	}
+
+	/* Line idle: the bytes below the trigger level are read on the RX timeout interrupt */
+	res->isr_ns_total += sim_irq(sim);
+	k_sleep(K_MSEC(2 * RX_TIMEOUT_MS));
+	uart_rx_disable(async_adapter);
+
+	uart_async_adapter_stats_get(async_adapter, &after);
+
+	res->irqs = after.irqs - before.irqs;
+	res->notifications = after.rx_notifications - before.rx_notifications;
+	res->dropped = after.rx_dropped - before.rx_dropped;
+	res->overruns = sim_data.overruns;
+	res->received = rx_received;
+}
+
+void main(void)
+{
+	const struct device *sim = device_get_binding("SIM_UART");
+	uint32_t max_baud = 0;
+	bool failed = false;
+
+	uart_async_adapter_init(async_adapter, sim);
+	uart_callback_set(async_adapter, uart_cb, NULL);
+
+	printk("UART async adapter benchmark (%s), %u bytes per run\n",
+	       IS_ENABLED(CONFIG_BT_NUS_UART_ASYNC_ADAPTER_BATCHED) ? "batched" : "direct",
+	       BENCH_BYTES);
+	printk("baud\tirq/KB\trdy/KB\tavg isr us\tmax isr us\toverruns\tdropped\treceived\n");
+
+	for (int i = 0; i < ARRAY_SIZE(bauds); i++) {
+		struct bench_result res;
+
+		bench_run(sim, bauds[i], &res);
+
+		printk("%u\t%u\t%u\t%u\t\t%u\t\t%u\t\t%u\t%u\n", bauds[i],
+		       res.irqs * 1024 / BENCH_BYTES, res.notifications * 1024 / BENCH_BYTES,
+		       (uint32_t)(res.isr_ns_total / res.irqs / 1000), res.isr_ns_max / 1000,
+		       res.overruns, res.dropped, res.received);
+
+		failed |= (res.overruns || res.dropped || (res.received != BENCH_BYTES));
+		if (!failed) {
+			max_baud = bauds[i];
+		}
+	}
+
+	printk("Maximum sustained baud rate without overruns: %u\n", max_baud);
+}